@@ -19,6 +19,8 @@
 #include <apt-pkg/error.h>
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/sptr.h>
+#include <apt-pkg/satsolver.h>
+#include <apt-pkg/scopeexit.h>
 
 // CNC:2002-07-04
 #include <apt-pkg/pkgsystem.h>
@@ -26,9 +28,14 @@
 
 #include <apti18n.h>
 
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <set>
+#include <sstream>
+#include <vector>
+
+#include <sys/time.h>
 									/*}}}*/
 using namespace std;
 
@@ -973,6 +980,166 @@ int pkgProblemResolver::ScoreSort(const void *a,const void *b)
    return 0;
 }
 									/*}}}*/
+// ProblemResolver::StartQueue - Empty the work queue			/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgProblemResolver::StartQueue()
+{
+   unsigned long Size = Cache.Head().PackageCount;
+   if (PkgByID.size() != Size)
+   {
+      PkgByID.resize(Size);
+      for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
+	 PkgByID[I->ID] = I;
+   }
+   Queue.clear();
+   QueuePos.assign(Size,NotQueued);
+   Written.clear();
+}
+									/*}}}*/
+// ProblemResolver::Queue* - Binary heap of the queued packages		/*{{{*/
+// ---------------------------------------------------------------------
+/* Ordered as ScoreSort orders the package list, the best scored first
+   and in the order of the cache for equal scores. */
+void pkgProblemResolver::QueueUp(unsigned long I)
+{
+   unsigned long ID = Queue[I];
+   while (I != 0)
+   {
+      unsigned long Parent = (I - 1) >> 1;
+      if (Before(ID,Queue[Parent]) == false)
+	 break;
+      Queue[I] = Queue[Parent];
+      QueuePos[Queue[I]] = I;
+      I = Parent;
+   }
+   Queue[I] = ID;
+   QueuePos[ID] = I;
+}
+void pkgProblemResolver::QueueDown(unsigned long I)
+{
+   unsigned long ID = Queue[I];
+   while (true)
+   {
+      unsigned long Child = 2*I + 1;
+      if (Child >= Queue.size())
+	 break;
+      if (Child + 1 < Queue.size() && Before(Queue[Child + 1],Queue[Child]))
+	 Child++;
+      if (Before(Queue[Child],ID) == false)
+	 break;
+      Queue[I] = Queue[Child];
+      QueuePos[Queue[I]] = I;
+      I = Child;
+   }
+   Queue[I] = ID;
+   QueuePos[ID] = I;
+}
+void pkgProblemResolver::Push(unsigned long ID)
+{
+   if (QueuePos[ID] != NotQueued)
+      return;
+   Queue.push_back(ID);
+   QueueUp(Queue.size() - 1);
+}
+unsigned long pkgProblemResolver::Pop()
+{
+   unsigned long ID = Queue[0];
+   QueuePos[ID] = NotQueued;
+   Queue[0] = Queue.back();
+   Queue.pop_back();
+   if (Queue.empty() == false)
+   {
+      QueuePos[Queue[0]] = 0;
+      QueueDown(0);
+   }
+   return ID;
+}
+									/*}}}*/
+// ProblemResolver::SetScore - Change a score, moving it in the queue	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgProblemResolver::SetScore(unsigned long ID,signed short Score)
+{
+   Scores[ID] = Score;
+   if (QueuePos[ID] == NotQueued)
+      return;
+   QueueUp(QueuePos[ID]);
+   QueueDown(QueuePos[ID]);
+}
+									/*}}}*/
+// ProblemResolver::StartBudget - Start a run with a full budget	/*{{{*/
+// ---------------------------------------------------------------------
+/* Max-Time may be a fraction of a second, read whatever the locale. */
+void pkgProblemResolver::StartBudget()
+{
+   MaxSteps = _config->FindI("APT::Resolver::Max-Steps",0);
+   std::istringstream Time(_config->Find("APT::Resolver::Max-Time","0"));
+   Time.imbue(std::locale::classic());
+   if (!(Time >> MaxSeconds) || MaxSeconds < 0)
+      MaxSeconds = 0;
+   struct timeval Now;
+   gettimeofday(&Now,0);
+   Begin = Now.tv_sec + Now.tv_usec/1000000.0;
+   Used.Steps = 0;
+   Used.Seconds = 0;
+   Used.Exhausted = false;
+   Left.clear();
+}
+									/*}}}*/
+// ProblemResolver::Spend - Count steps against the budget		/*{{{*/
+// ---------------------------------------------------------------------
+/* A step is a package looked at, or a conflict met by the SAT solver.
+   False, without counting them, once the budget ran out. */
+bool pkgProblemResolver::Spend(unsigned long Steps)
+{
+   if (Used.Exhausted == true)
+      return false;
+
+   struct timeval Now;
+   gettimeofday(&Now,0);
+   Used.Seconds = Now.tv_sec + Now.tv_usec/1000000.0 - Begin;
+   if ((MaxSteps != 0 && Used.Steps + Steps > MaxSteps) ||
+       (MaxSeconds != 0 && Used.Seconds >= MaxSeconds))
+      Used.Exhausted = true;
+   else
+      Used.Steps += Steps;
+   return Used.Exhausted == false;
+}
+									/*}}}*/
+// ProblemResolver::ListProblems - Collect the broken dependencies	/*{{{*/
+// ---------------------------------------------------------------------
+/* Every critical or group left broken, by its first dependency. A
+   warning tells about them when the budget ran out. */
+void pkgProblemResolver::ListProblems()
+{
+   Left.clear();
+   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
+   {
+      if (Cache[I].InstallVer == 0 || Cache[I].InstBroken() == false)
+	 continue;
+      for (pkgCache::DepIterator D = Cache[I].InstVerIter(Cache).DependsList(); D.end() == false;)
+      {
+	 DepIterator Start;
+	 DepIterator End;
+	 D.GlobOr(Start,End);
+	 if (End.IsCritical() == false ||
+	     (Cache[End] & pkgDepCache::DepGInstall) == pkgDepCache::DepGInstall)
+	    continue;
+	 Problem P = {I,Start};
+	 Left.push_back(P);
+      }
+   }
+
+   if (Debug == true)
+      for (vector<Problem>::iterator P = Left.begin(); P != Left.end(); ++P)
+	 clog << "  Unresolved: " << P->Pkg.Name() << ' '
+	      << P->Dep.DepType() << ' ' << P->Dep.TargetPkg().Name() << endl;
+   if (Used.Exhausted == true)
+      _error->Warning(_("The problem resolver stopped after %lu steps and %.1f seconds, leaving %lu broken dependencies"),
+		      Used.Steps,Used.Seconds,(unsigned long)Left.size());
+}
+									/*}}}*/
 // ProblemResolver::MakeScores - Make the score table			/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -1215,6 +1382,11 @@ bool pkgProblemResolver::DoUpgrade(pkgCache::PkgIterator Pkg)
    upgrade packages to advoid problems. */
 bool pkgProblemResolver::Resolve(bool BrokenFix)
 {
+   StartBudget();
+   if (_config->Find("APT::Resolver","classic") == "sat" &&
+       ResolveSat(BrokenFix,false) == true)
+      return true;
+
    unsigned long Size = Cache.Head().PackageCount;
 
    // Record which packages are marked for install
@@ -1247,25 +1419,33 @@ bool pkgProblemResolver::Resolve(bool BrokenFix)
 
    MakeScores();
 
-   /* We have to order the packages so that the broken fixing pass
-      operates from highest score to lowest. This prevents problems when
-      high score packages cause the removal of lower score packages that
-      would cause the removal of even lower score packages. */
-   const SPtrArray<pkgCache::Package *> PList(new pkgCache::Package *[Size]);
-   pkgCache::Package **PEnd = PList.get();
-   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
-      *PEnd++ = I;
-   This = this;
-   qsort(PList.get(),PEnd - PList.get(),sizeof(PList[0]),&ScoreSort);
-
-/* for (pkgCache::Package **K = PList; K != PEnd; K++)
-      if (Scores[(*K)->ID] != 0)
-      {
-	 pkgCache::PkgIterator Pkg(Cache,*K);
-	 clog << Scores[(*K)->ID] << ' ' << Pkg.Name() <<
-	    ' ' << (pkgCache::Version *)Pkg.CurrentVer() << ' ' <<
-	    Cache[Pkg].InstallVer << ' ' << Cache[Pkg].CandidateVer << endl;
-      } */
+   /* The packages are looked at from the highest score to the lowest.
+      This prevents problems when high score packages cause the removal
+      of lower score packages that would cause the removal of even lower
+      score packages. Only the broken packages and those which may be
+      re-instated are queued, and then those whose state changes while
+      others are fixed. */
+   auto Wanted = [this](unsigned long ID) {
+      pkgCache::PkgIterator I(Cache,PkgByID[ID]);
+      pkgDepCache::StateCache &P = Cache[I];
+      if (P.InstallVer != 0 && P.InstBroken() == true)
+	 return true;
+      return P.CandidateVer != P.InstallVer && I->CurrentVer != 0 &&
+	     P.InstallVer != 0 &&
+	     (Flags[ID] & (PreInstalled | Protected | ReInstateTried)) == PreInstalled;
+   };
+   StartQueue();
+   for (unsigned long ID = 0; ID != Size; ID++)
+      if (Wanted(ID) == true)
+	 Push(ID);
+   vector<unsigned long> Next;
+   vector<bool> InNext(Size);
+   Cache.TrackWrites(&Written);
+   scope_exit Untrack([this]() {Cache.TrackWrites(0);});
+
+   // With a budget the state with the least breaks is kept to fall back to
+   const bool Limited = MaxSteps != 0 || MaxSeconds != 0;
+   pkgDepCache::State Best(Limited == true ? &Cache : 0);
 
    if (Debug == true)
       clog << "Starting 2" << endl;
@@ -1275,12 +1455,46 @@ bool pkgProblemResolver::Resolve(bool BrokenFix)
       not be possible for a loop to form (that is a < b < c and fixing b by
       changing a breaks c) */
    bool Change = true;
-   for (int Counter = 0; Counter != 10 && Change == true; Counter++)
+   for (int Counter = 0; Counter != 10 && Change == true &&
+	Used.Exhausted == false; Counter++)
    {
       Change = false;
-      for (pkgCache::Package **K = PList.get(); K != PEnd; K++)
+      for (vector<unsigned long>::const_iterator J = Next.begin(); J != Next.end(); ++J)
+      {
+	 InNext[*J] = false;
+	 Push(*J);
+      }
+      Next.clear();
+
+      unsigned long Cur = NotQueued;
+      while (true)
       {
-	 pkgCache::PkgIterator I(Cache,*K);
+	 /* What the last package changed is looked at in this pass if it
+	    comes after it, else in the next one, as would be done going
+	    down the sorted list of every package. The last package itself
+	    comes again in the next pass if it still needs to. */
+	 if (Cur != NotQueued)
+	    Written.push_back(Cur);
+	 for (vector<unsigned long>::const_iterator J = Written.begin(); J != Written.end(); ++J)
+	 {
+	    if (Wanted(*J) == false)
+	       continue;
+	    if (Cur != NotQueued && Before(Cur,*J) == true)
+	       Push(*J);
+	    else if (QueuePos[*J] == NotQueued && InNext[*J] == false)
+	    {
+	       InNext[*J] = true;
+	       Next.push_back(*J);
+	    }
+	 }
+	 Written.clear();
+
+	 if (Limited == true && Cache.BrokenCount() < Best.BrokenCount())
+	    Best.Save(&Cache);
+	 if (Queue.empty() == true || Spend(1) == false)
+	    break;
+	 Cur = Pop();
+	 pkgCache::PkgIterator I(Cache,PkgByID[Cur]);
 
 	 /* We attempt to install this and see if any breaks result,
 	    this takes care of some strange cases */
@@ -1425,7 +1639,7 @@ bool pkgProblemResolver::Resolve(bool BrokenFix)
 		     if (DoUpgrade(Pkg) == true)
 		     {
 			if (Scores[Pkg->ID] > Scores[I->ID])
-			   Scores[Pkg->ID] = Scores[I->ID];
+			   SetScore(Pkg->ID,Scores[I->ID]);
 			break;
 		     }
 
@@ -1462,7 +1676,7 @@ bool pkgProblemResolver::Resolve(bool BrokenFix)
 			   if (Counter > 1)
 			   {
 			      if (Scores[Pkg->ID] > Scores[I->ID])
-				 Scores[I->ID] = Scores[Pkg->ID];
+				 SetScore(I->ID,Scores[Pkg->ID]);
 			   }
 			}
 		     }
@@ -1587,7 +1801,7 @@ bool pkgProblemResolver::Resolve(bool BrokenFix)
 	       if (Counter > 1)
 	       {
 		  if (Scores[I->ID] > Scores[J->Pkg->ID])
-		     Scores[J->Pkg->ID] = Scores[I->ID];
+		     SetScore(J->Pkg->ID,Scores[I->ID]);
 	       }
 	    }
 	 }
@@ -1597,8 +1811,16 @@ bool pkgProblemResolver::Resolve(bool BrokenFix)
    if (Debug == true)
       clog << "Done" << endl;
 
+   if (Used.Exhausted == true && Best.BrokenCount() < Cache.BrokenCount())
+      Best.Restore();
+   if (Debug == true)
+      clog << "Resolver used " << Used.Steps << " steps in "
+	   << Used.Seconds << "s" << endl;
+
    if (Cache.BrokenCount() != 0)
    {
+      ListProblems();
+
       // See if this is the result of a hold
       pkgCache::PkgIterator I = Cache.PkgBegin();
       for (;I.end() != true; I++)
@@ -1621,6 +1843,11 @@ bool pkgProblemResolver::Resolve(bool BrokenFix)
    system was non-broken previously. */
 bool pkgProblemResolver::ResolveByKeep()
 {
+   StartBudget();
+   if (_config->Find("APT::Resolver","classic") == "sat" &&
+       ResolveSat(false,true) == true)
+      return true;
+
    unsigned long Size = Cache.Head().PackageCount;
 
    if (Debug == true)
@@ -1628,22 +1855,41 @@ bool pkgProblemResolver::ResolveByKeep()
 
    MakeScores();
 
-   /* We have to order the packages so that the broken fixing pass
-      operates from highest score to lowest. This prevents problems when
-      high score packages cause the removal of lower score packages that
-      would cause the removal of even lower score packages. */
-   pkgCache::Package **PList = new pkgCache::Package *[Size];
-   pkgCache::Package **PEnd = PList;
-   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
-      *PEnd++ = I;
-   This = this;
-   qsort(PList,PEnd - PList,sizeof(*PList),&ScoreSort);
+   /* The broken packages are fixed from the highest score to the lowest.
+      This prevents problems when high score packages cause the removal of
+      lower score packages that would cause the removal of even lower
+      score packages. Fixing one may break others, those are queued with
+      the rest whatever their score. */
+   auto Broken = [this](unsigned long ID) {
+      pkgDepCache::StateCache &P = Cache[pkgCache::PkgIterator(Cache,PkgByID[ID])];
+      return P.InstallVer != 0 && P.InstBroken() == true;
+   };
+   StartQueue();
+   for (unsigned long ID = 0; ID != Size; ID++)
+      if (Broken(ID) == true)
+	 Push(ID);
+   Cache.TrackWrites(&Written);
+   scope_exit Untrack([this]() {Cache.TrackWrites(0);});
+
+   // With a budget the state with the least breaks is kept to fall back to
+   const bool Limited = MaxSteps != 0 || MaxSeconds != 0;
+   pkgDepCache::State Best(Limited == true ? &Cache : 0);
 
    // Consider each broken package
-   pkgCache::Package **LastStop = 0;
-   for (pkgCache::Package **K = PList; K != PEnd; K++)
+   unsigned long LastStop = NotQueued;
+   vector<unsigned char> Fixes(Size);
+   while (true)
    {
-      pkgCache::PkgIterator I(Cache,*K);
+      for (vector<unsigned long>::const_iterator J = Written.begin(); J != Written.end(); ++J)
+	 if (Broken(*J) == true)
+	    Push(*J);
+      Written.clear();
+
+      if (Limited == true && Cache.BrokenCount() < Best.BrokenCount())
+	 Best.Save(&Cache);
+      if (Queue.empty() == true || Spend(1) == false)
+	 break;
+      pkgCache::PkgIterator I(Cache,PkgByID[Pop()]);
 
       if (Cache[I].InstallVer == 0 || Cache[I].InstBroken() == false)
 	 continue;
@@ -1656,10 +1902,7 @@ bool pkgProblemResolver::ResolveByKeep()
 	    clog << "Keeping package " << I.Name() << endl;
 	 Cache.MarkKeep(I);
 	 if (Cache[I].InstBroken() == false)
-	 {
-	    K = PList - 1;
 	    continue;
-	 }
       }
 
       // Isolate the problem dependencies
@@ -1725,13 +1968,271 @@ bool pkgProblemResolver::ResolveByKeep()
       if (Cache[I].InstBroken() == true)
 	 continue;
 
-      // Restart again.
-      if (K == LastStop)
+      // Fixed again right after the last time, or too many times
+      if (I->ID == LastStop || ++Fixes[I->ID] == 10)
 	 return _error->Error("Internal Error, pkgProblemResolver::ResolveByKeep is looping on package %s.",I.Name());
-      LastStop = K;
-      K = PList - 1;
+      LastStop = I->ID;
    }
 
+   if (Used.Exhausted == true && Best.BrokenCount() < Cache.BrokenCount())
+      Best.Restore();
+   if (Debug == true)
+      clog << "Resolver used " << Used.Steps << " steps in "
+	   << Used.Seconds << "s" << endl;
+   if (Cache.BrokenCount() != 0)
+      ListProblems();
+
+   return true;
+}
+									/*}}}*/
+// ProblemResolver::ResolveSat - Resolve problems with a SAT solver	/*{{{*/
+// ---------------------------------------------------------------------
+/* Each package may end up with the version it is marked for, its
+   installed version, the candidate when BrokenFix allows upgrading it,
+   or none. Each of those versions is a variable, tied to a variable for
+   the package being installed at all, and the critical dependencies of
+   the versions are clauses over them, so the whole problem is solved at
+   once. The best scored packages are decided first, installed as they
+   are marked, and the marked version is tried before the installed one
+   before the candidate. Protected packages keep their mark and nothing
+   installed is removed by ResolveByKeep.
+
+   The solution is marked in the cache. If there is none, or marking it
+   still leaves breaks, the cache is restored and false returned for the
+   classic pass to run instead. */
+bool pkgProblemResolver::ResolveSat(bool BrokenFix,bool KeepOnly)
+{
+   typedef pkgSatSolver::Var Var;
+   typedef pkgSatSolver::Lit Lit;
+   const Var NoVar = pkgSatSolver::NoVar;
+
+   if (Cache.BrokenCount() == 0)
+      return true;
+
+   struct timeval Start;
+   gettimeofday(&Start,0);
+
+   MakeScores();
+   signed short Min = 0;
+   signed short Max = 0;
+   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
+   {
+      Min = std::min(Min,Scores[I->ID]);
+      Max = std::max(Max,Scores[I->ID]);
+   }
+
+   /* Packages obsoleted by a marked version are rather removed than
+      kept, as the upgrade replaces them */
+   vector<bool> Replaced(Cache.Head().PackageCount);
+   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
+   {
+      if (Cache[I].InstallVer == 0)
+	 continue;
+      for (pkgCache::DepIterator D = Cache[I].InstVerIter(Cache).DependsList(); D.end() == false; D++)
+      {
+	 pkgCache::PkgIterator T = D.TargetPkg();
+	 if (D->Type == pkgCache::Dep::Obsoletes && T != I &&
+	     T->CurrentVer != 0 &&
+	     Cache.VS().CheckDep(T.CurrentVer().VerStr(),D) == true)
+	    Replaced[T->ID] = true;
+      }
+   }
+
+   // One variable per allowed version and one per package
+   pkgSatSolver Solver;
+   vector<Var> VerVar(Cache.Head().VersionCount,NoVar);
+   vector<Var> PkgVar(Cache.Head().PackageCount,NoVar);
+   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
+   {
+      pkgDepCache::StateCache &P = Cache[I];
+      Version *Dom[3];
+      unsigned int N = 0;
+      auto Allow = [&Dom,&N](Version *V) {
+	 if (V == 0 || find(Dom,Dom + N,V) != Dom + N)
+	    return;
+	 Dom[N++] = V;
+      };
+      Allow(P.InstallVer);
+      if ((Flags[I->ID] & Protected) == 0 && I->CurrentVer != 0)
+      {
+	 // MarkKeep refuses to keep these
+	 if (I.State() != pkgCache::PkgIterator::NeedsUnpack ||
+	     I.CurrentVer().Downloadable() == true)
+	    Allow(I.CurrentVer());
+	 if (BrokenFix == true && KeepOnly == false)
+	    Allow(P.CandidateVer);
+      }
+      if (N == 0)
+	 continue;
+
+      const double Rank = (Scores[I->ID] - Min)/(Max - Min + 1.0);
+      const bool Want = P.InstallVer != 0 && Replaced[I->ID] == false;
+      if (N == 1)
+      {
+	 PkgVar[I->ID] = VerVar[Dom[0]->ID] = Solver.NewVar(Want,1 + Rank);
+	 continue;
+      }
+
+      Var Inst = PkgVar[I->ID] = Solver.NewVar(Want,1 + Rank);
+      vector<Lit> Any(1,pkgSatSolver::Neg(Inst));
+      for (unsigned int K = 0; K != N; K++)
+      {
+	 Var V = VerVar[Dom[K]->ID] = Solver.NewVar(true,Rank);
+	 if (K != 0)
+	    Solver.SetFallback(V,VerVar[Dom[K-1]->ID]);
+	 Any.push_back(pkgSatSolver::Pos(V));
+	 Solver.AddClause({pkgSatSolver::Neg(V),pkgSatSolver::Pos(Inst)});
+	 for (unsigned int L = 0; L != K; L++)
+	    Solver.AddClause({pkgSatSolver::Neg(V),
+			      pkgSatSolver::Neg(VerVar[Dom[L]->ID])});
+      }
+      Solver.AddClause(Any);
+   }
+
+   // Marks which may not change
+   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
+   {
+      if (PkgVar[I->ID] == NoVar)
+	 continue;
+      if ((Flags[I->ID] & Protected) == Protected ||
+	  (KeepOnly == true && I->CurrentVer != 0))
+	 Solver.AddClause({pkgSatSolver::Pos(PkgVar[I->ID])});
+   }
+
+   // The critical dependencies of every allowed version
+   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
+   {
+      for (pkgCache::VerIterator V = I.VersionList(); V.end() == false; V++)
+      {
+	 Var X = VerVar[V->ID];
+	 if (X == NoVar)
+	    continue;
+
+	 for (pkgCache::DepIterator D = V.DependsList(); D.end() == false;)
+	 {
+	    DepIterator Start;
+	    DepIterator End;
+	    D.GlobOr(Start,End);
+	    if (End.IsCritical() == false)
+	       continue;
+
+	    // Conflicts against each version they match, never or'ed
+	    if (Start->Type == pkgCache::Dep::Conflicts ||
+		Start->Type == pkgCache::Dep::Obsoletes)
+	    {
+	       const SPtrArray<pkgCache::Version *> VList(Start.AllTargets());
+	       for (pkgCache::Version **T = VList.get(); *T != 0; T++)
+	       {
+		  // Obsoletes do not apply to provides
+		  if (VerVar[(*T)->ID] == NoVar ||
+		      (Start->Type == pkgCache::Dep::Obsoletes &&
+		       pkgCache::VerIterator(Cache,*T).ParentPkg() != Start.TargetPkg()))
+		     continue;
+		  Solver.AddClause({pkgSatSolver::Neg(X),
+				    pkgSatSolver::Neg(VerVar[(*T)->ID])});
+	       }
+	       continue;
+	    }
+
+	    // Depends need one of the versions of the group
+	    vector<Lit> Clause(1,pkgSatSolver::Neg(X));
+	    bool Ignored = false;
+	    while (true)
+	    {
+	       if (_system->IgnoreDep(Cache.VS(),Start) == true)
+		  Ignored = true;
+	       const SPtrArray<pkgCache::Version *> VList(Start.AllTargets());
+	       for (pkgCache::Version **T = VList.get(); *T != 0; T++)
+		  if (VerVar[(*T)->ID] != NoVar)
+		     Clause.push_back(pkgSatSolver::Pos(VerVar[(*T)->ID]));
+	       if (Start == End)
+		  break;
+	       Start++;
+	    }
+	    if (Ignored == false)
+	       Solver.AddClause(Clause);
+	 }
+      }
+   }
+
+   // Whatever is left of the budget
+   unsigned long Steps = 0;
+   if (MaxSteps != 0)
+      Steps = std::max(MaxSteps - std::min(MaxSteps,Used.Steps),1UL);
+   double Seconds = 0;
+   if (MaxSeconds != 0)
+      Seconds = std::max(MaxSeconds - Used.Seconds,0.001);
+   pkgSatSolver::Result Res = Solver.Solve(Steps,Seconds);
+   Used.Steps += Solver.Conflicts;
+   Spend(0);
+   // The solver stops right at the limit, which Spend() does not count
+   if (Res == pkgSatSolver::Unknown)
+      Used.Exhausted = true;
+
+   struct timeval Now;
+   gettimeofday(&Now,0);
+   if (Debug == true)
+      clog << "SAT resolver: " << Solver.VarCount() << " variables, "
+	   << Solver.ClauseCount() << " clauses, "
+	   << Solver.Decisions << " decisions, "
+	   << Solver.Conflicts << " conflicts, "
+	   << Solver.Learnt << " learnt, "
+	   << Solver.Restarts << " restarts in "
+	   << (Now.tv_sec - Start.tv_sec)*1000 + (Now.tv_usec - Start.tv_usec)/1000
+	   << "ms" << endl;
+
+   if (Res != pkgSatSolver::Sat)
+   {
+      if (Debug == true)
+	 clog << "SAT resolver found no solution, falling back" << endl;
+      return false;
+   }
+
+   // Mark the solution
+   pkgDepCache::State Before(&Cache);
+   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
+   {
+      if (PkgVar[I->ID] == NoVar)
+	 continue;
+
+      Version *Ver = 0;
+      for (pkgCache::VerIterator V = I.VersionList(); V.end() == false; V++)
+	 if (VerVar[V->ID] != NoVar && Solver.Value(VerVar[V->ID]) == true)
+	    Ver = V;
+      if (Ver == Cache[I].InstallVer)
+	 continue;
+
+      if (Ver == 0)
+      {
+	 if (Debug == true)
+	    clog << "  Removing " << I.Name() << endl;
+	 if (KeepOnly == true || I->CurrentVer == 0)
+	    Cache.MarkKeep(I);
+	 else
+	    Cache.MarkDelete(I);
+      }
+      else if (Ver == (Version *)I.CurrentVer())
+      {
+	 if (Debug == true)
+	    clog << "  Keeping " << I.Name() << endl;
+	 Cache.MarkKeep(I);
+      }
+      else
+      {
+	 if (Debug == true)
+	    clog << "  Installing " << I.Name() << endl;
+	 Cache.MarkInstall(I,pkgDepCache::AutoMarkFlag::DontChange,false);
+      }
+   }
+
+   if (Cache.BrokenCount() != 0)
+   {
+      if (Debug == true)
+	 clog << "SAT resolver solution left " << Cache.BrokenCount()
+	      << " broken packages, falling back" << endl;
+      Before.Restore();
+      return false;
+   }
    return true;
 }
 									/*}}}*/
@@ -36,6 +36,7 @@
 #include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 using std::ostream;
 
@@ -103,8 +104,58 @@ class pkgProblemResolver
       DepIterator Dep;
    };
 
+   /* Packages waiting to be looked at, by ID, the best scored first,
+      and the position of each in the heap, NotQueued if it is not there.
+      Written gets the packages whose state changed meanwhile. */
+   static constexpr unsigned long NotQueued = ~0UL;
+   std::vector<Package *> PkgByID;
+   std::vector<unsigned long> Queue;
+   std::vector<unsigned long> QueuePos;
+   std::vector<unsigned long> Written;
+
+   inline bool Before(unsigned long A,unsigned long B) const
+      {return Scores[A] > Scores[B] || (Scores[A] == Scores[B] && A < B);}
+   void QueueUp(unsigned long I);
+   void QueueDown(unsigned long I);
+   void Push(unsigned long ID);
+   unsigned long Pop();
+   void SetScore(unsigned long ID,signed short Score);
+   void StartQueue();
+
+   public:
+
+   // What the last run used of the budget set by APT::Resolver::Max-*
+   struct Budget
+   {
+      unsigned long Steps;
+      double Seconds;
+      bool Exhausted;
+   };
+
+   // A critical dependency left broken by the last run
+   struct Problem
+   {
+      PkgIterator Pkg;
+      DepIterator Dep;
+   };
+
+   private:
+
+   unsigned long MaxSteps;
+   double MaxSeconds;
+   double Begin;
+   Budget Used;
+   std::vector<Problem> Left;
+
+   void StartBudget();
+   bool Spend(unsigned long Steps);
+   void ListProblems();
+
    bool DoUpgrade(pkgCache::PkgIterator Pkg);
 
+   // The APT::Resolver "sat" engine, true if it left nothing broken
+   bool ResolveSat(bool BrokenFix,bool KeepOnly);
+
    public:
 
    inline void Protect(const pkgCache::PkgIterator &Pkg) {Flags[Pkg->ID] |= Protected;}
@@ -121,6 +172,11 @@ class pkgProblemResolver
 
    bool RemoveDepends(); // CNC:2002-08-01
 
+   /* When the budget ran out the runs stop with the best state they saw,
+      these tell what was used and what is still broken */
+   inline const Budget &Spent() const {return Used;}
+   inline const std::vector<Problem> &Problems() const {return Left;}
+
    pkgProblemResolver(pkgDepCache *Cache);
    ~pkgProblemResolver();
 
@@ -121,6 +121,9 @@ class pkgCache::VerIterator
    inline const char *VerStr() const {return Ver->VerStr == 0?0:Owner->StrP + Ver->VerStr;}
    inline const char *Section() const {return Ver->Section == 0?0:Owner->StrP + Ver->Section;}
    inline const char *Arch() const {return Ver->Arch == 0?0:Owner->StrP + Ver->Arch;}
+   inline const char *Summary() const {return Ver->Summary == 0?0:Owner->StrP + Ver->Summary;}
+   inline const char *Description() const {return Ver->Description == 0?0:Owner->StrP + Ver->Description;}
+   inline const char *Packager() const {return Ver->Packager == 0?0:Owner->StrP + Ver->Packager;}
    inline PkgIterator ParentPkg() const {return PkgIterator(*Owner,Owner->PkgP + Ver->ParentPkg);}
    inline DepIterator DependsList() const;
    inline PrvIterator ProvidesList() const;
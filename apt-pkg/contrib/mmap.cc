@@ -35,6 +35,7 @@
 #include <cstring>
 #include <type_traits>
 #include <cassert>
+#include <algorithm>
 									/*}}}*/
 
 // MMap::MMap - Constructor						/*{{{*/
@@ -157,86 +158,85 @@ bool MMap::Sync(unsigned long const Start,unsigned long const Stop)
 }
 									/*}}}*/
 
+// PageAlign - Round a size up to whole pages				/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+static size_t PageAlign(size_t const Size)
+{
+   size_t const PageSize = sysconf(_SC_PAGESIZE);
+   return (Size + PageSize - 1) / PageSize * PageSize;
+}
+									/*}}}*/
 // DynamicMMap::DynamicMMap - Constructor				/*{{{*/
 // ---------------------------------------------------------------------
 /* */
 DynamicMMap::DynamicMMap(FileFd &F,
                          unsigned long const Flags,
-                         size_t const RequestedWorkSpace) :
-   MMap(F,Flags | NoImmMap), /* NoImmMap to invoke MMap::Map() ourselves */
+                         size_t const RequestedWorkSpace,
+                         size_t const Limit) :
+   MMap(F,Flags | NoImmMap), /* NoImmMap: the mapping is done by Reserve() */
    Fd(&F),
-   WorkSpace(0) // invalidate before all the structure is set up
+   WorkSpace(0), // invalidate before all the structure is set up
+   Limit(Limit),
+   GrowCount(0)
 {
    if (_error->PendingError() == true)
       return;
 
    /* Purpose of MMap::iSize:
 
-      1. It is set by MMap::Map() to the size of the mmap'ed region
-      (determined by the file size)
-      and is used by ~MMap() to determine the size of the region to munmap.
-
-      2. Additionally, in the course of work, DynamicMMap uses MMap::iSize
-      to track the size of the region already occupied by allocations; i.e.,
-      Base+iSize is the beginning of the free space.
-
-      The two purposes are not obviously conflict-free with each
-      other, therefore DynamicMMap() constructor needs to take special
-      care to leave it in a state suitable for the second purpose
-      (DynamicMMap's course of work), and ~DynamicMMap() destructor
-      needs to do special tweaks to satisfy the expectations of ~MMap()
-      according to the first purpose, in spite of iSize not reflecting
-      the size of the whole mmap'ed region already at the end of work.
-
-      DynamicMMap::WorkSpace is the size of the whole region available
-      for new allocations and holding already allocated stuff. So, in
-      this constructor, we must make WorkSpace at least as big as the
-      already allocated and saved stuff in the file initially
-      and at least as big as RequestedWorkSpace.
+      1. In MMap it is the size of the mmap'ed region (determined by the
+      file size) and is used by ~MMap() to determine the size of the region
+      to munmap.
+
+      2. DynamicMMap uses MMap::iSize to track the size of the region
+      already occupied by allocations; i.e., Base+iSize is the beginning
+      of the free space.
+
+      Only the second one applies here: ~DynamicMMap() unmaps the whole
+      reserved region itself, before ~MMap() runs.
+
+      DynamicMMap::WorkSpace is the size of the region available for new
+      allocations and holding already allocated stuff, and the backing file
+      is kept as big. So, in this constructor, we must make WorkSpace at
+      least as big as the already allocated and saved stuff in the file
+      initially and at least as big as RequestedWorkSpace. It grows later
+      on, up to Limit, as needed.
    */
 
    auto const EndOfFile = Fd->Size();
 
-   /* The backing file must be made at least as big as the requested workspace
-      that we are going to use in the course of work.
-   */
-   if (EndOfFile < RequestedWorkSpace)
+   // Check that the file size is in the range of size_t.
+   static_assert(std::is_unsigned_v<decltype(EndOfFile)>,
+                 "we want to rely that Fd::Size() is unsigned");
+   if (EndOfFile > SIZE_MAX)
    {
-      if (!Fd->Truncate(RequestedWorkSpace))
-         return;
+      _error->Error(_("File of %ju bytes is too large for mmap(2)"),
+                    static_cast<uintmax_t>(EndOfFile));
+      return;
    }
 
-   if (!Map(F))
+   if (!Reserve(std::max(static_cast<size_t>(EndOfFile),RequestedWorkSpace)))
       return;
 
-   /* Map(F) has set iSize to the size of the whole, possibly extended file */
-
-   WorkSpace = iSize;
-
-   /* Now decrease iSize back to only the already allocated stuff
-      (that which has been saved in the file before extension)
-      -- to satisfy the expectations of DynamicMMap methods.
-
-      Note that at this moment Map(F) has ensured the file size fits size_t.
-      (This note applies to the current size of the extended file as well as
-      the initial size EndOfFile.)
-   */
-   static_assert(std::is_unsigned_v<decltype(EndOfFile)>,
-                 "we want to rely that Fd::Size() is unsigned");
    iSize = static_cast<size_t>(EndOfFile);
 }
 									/*}}}*/
 // DynamicMMap::DynamicMMap - Constructor for a non-file backed map	/*{{{*/
 // ---------------------------------------------------------------------
-/* This is just a fancy malloc really.. */
-DynamicMMap::DynamicMMap(unsigned long const Flags,size_t const WorkSpace) :
-             MMap(Flags | NoImmMap | UnMapped), Fd(0), WorkSpace(WorkSpace)
+/* This is just a fancy malloc really.. The memory comes zeroed and is
+   only really allocated once it is used. */
+DynamicMMap::DynamicMMap(unsigned long const Flags,
+                         size_t const RequestedWorkSpace,
+                         size_t const Limit) :
+             MMap(Flags | NoImmMap | UnMapped), Fd(0), WorkSpace(0),
+             Limit(Limit), GrowCount(0)
 {
    if (_error->PendingError() == true)
       return;
 
-   // allocate and zero memory
-   Base = new unsigned char[WorkSpace]();
+   if (!Reserve(RequestedWorkSpace))
+      return;
    iSize = 0;
 }
 									/*}}}*/
@@ -245,25 +245,98 @@ DynamicMMap::DynamicMMap(unsigned long const Flags,size_t const WorkSpace) :
 /* We truncate the file to the size of the memory data set */
 DynamicMMap::~DynamicMMap()
 {
-   if (Fd == 0)
-   {
-      delete [] (unsigned char *)Base;
+   if (Base == nullptr)
       return;
-   }
 
    size_t const EndOfFile = iSize;
 
-   /* Prepare for Close(): iSize determines the region to be munmap'ed and
-      therefore needs to be set to the whole file-backed workspace.
-   */
-   iSize = WorkSpace;
-
-   Close(false);
+   if (munmap(Base,Limit) != 0)
+      _error->Warning("Unable to munmap");
+   Base = nullptr;
+   iSize = 0;
 
    /* Finally, truncate the file to the region used for our actual allocations.
-      (Not all of the initially mmap'ed workspace might have been used.)
+      (Not all of the workspace might have been used.)
     */
-   Fd->Truncate(EndOfFile);
+   if (Fd != 0 && WorkSpace != 0)
+      Fd->Truncate(EndOfFile);
+}
+									/*}}}*/
+// DynamicMMap::Reserve - Set up the workspace				/*{{{*/
+// ---------------------------------------------------------------------
+/* Address space is reserved for Limit bytes, which costs no memory, and
+   only the start of it is made usable. If there is not that much address
+   space then the workspace just can't grow. */
+bool DynamicMMap::Reserve(size_t const Size)
+{
+   size_t const Wanted = PageAlign(Size);
+   Limit = PageAlign(std::max(Limit,Wanted));
+
+   Base = mmap(0,Limit,PROT_NONE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,-1,0);
+   if (Base == MAP_FAILED && Limit != Wanted)
+   {
+      Limit = Wanted;
+      Base = mmap(0,Limit,PROT_NONE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,-1,0);
+   }
+   if (Base == MAP_FAILED)
+   {
+      Base = nullptr;
+      return _error->Errno("mmap",_("Couldn't make mmap of %zu bytes"),Limit);
+   }
+
+   return Commit(Wanted);
+}
+									/*}}}*/
+// DynamicMMap::Commit - Make more of the reserved space usable		/*{{{*/
+// ---------------------------------------------------------------------
+/* The new part is mapped over the reserved one, in place, from the file
+   extended to the new size or from anonymous memory. */
+bool DynamicMMap::Commit(size_t const NewWorkSpace)
+{
+   char * const Start = static_cast<char *>(Base) + WorkSpace;
+   size_t const Len = NewWorkSpace - WorkSpace;
+
+   void *Res;
+   if (Fd != 0)
+   {
+      if (!Fd->Truncate(NewWorkSpace))
+         return false;
+
+      int Prot = PROT_READ;
+      int Map = MAP_SHARED;
+      if ((Flags & ReadOnly) != ReadOnly)
+         Prot |= PROT_WRITE;
+      if ((Flags & Public) != Public)
+         Map = MAP_PRIVATE;
+      Res = mmap(Start,Len,Prot,Map | MAP_FIXED,Fd->Fd(),WorkSpace);
+   }
+   else
+      Res = mmap(Start,Len,PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,-1,0);
+
+   if (Res == MAP_FAILED)
+      return _error->Errno("mmap",_("Couldn't make mmap of %zu bytes"),NewWorkSpace);
+
+   WorkSpace = NewWorkSpace;
+   return true;
+}
+									/*}}}*/
+// DynamicMMap::Grow - Make room for Needed bytes in the workspace	/*{{{*/
+// ---------------------------------------------------------------------
+/* The workspace is at least doubled, so there are few growths even when
+   it starts much too small. */
+bool DynamicMMap::Grow(size_t const Needed)
+{
+   if (Needed > Limit)
+      return _error->Error("Dynamic MMap ran out of room");
+
+   size_t NewWorkSpace = WorkSpace > Limit/2 ? Limit : 2*WorkSpace;
+   NewWorkSpace = std::min(PageAlign(std::max(NewWorkSpace,Needed)),Limit);
+   if (!Commit(NewWorkSpace))
+      return false;
+
+   GrowCount++;
+   return true;
 }
 									/*}}}*/
 // DynamicMMap::RawAllocate - Allocate a raw chunk of unaligned space	/*{{{*/
@@ -273,25 +346,21 @@ std::optional<unsigned long> DynamicMMap::RawAllocate(size_t const Size,size_t c
 {
    unsigned long Result = iSize;
 
+   size_t Padding = 0;
    if (Aln != 0 && Result%Aln != 0)
-   {
-      size_t const Padding = Aln - (Result%Aln);
-      // Just in case error check
-      if (Padding > WorkSpace - Result)
-      {
-         _error->Error("Dynamic MMap ran out of room");
-         return std::nullopt;
-      }
-      Result += Padding;
-   }
+      Padding = Aln - (Result%Aln);
 
    // Just in case error check
-   if (Size > WorkSpace - Result)
+   if (Padding > SIZE_MAX - Result || Size > SIZE_MAX - Result - Padding)
    {
       _error->Error("Dynamic MMap ran out of room");
       return std::nullopt;
    }
 
+   if (Result + Padding + Size > WorkSpace && !Grow(Result + Padding + Size))
+      return std::nullopt;
+
+   Result += Padding;
    iSize = Result + Size;
 
    return Result;
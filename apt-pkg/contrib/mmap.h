@@ -14,7 +14,9 @@
 
    The DynamicMMap class is used to help the on-disk data structure
    generators. It provides a large allocated workspace and members
-   to allocate space from the workspace in an effecient fashion.
+   to allocate space from the workspace in an effecient fashion. The
+   workspace grows when it is full, without moving: enough address space
+   is reserved up front, so offsets and pointers into it stay valid.
 
    This source is placed in the Public Domain, do with it what you will
    It was originally written by Jason Gunthorpe.
@@ -89,15 +91,28 @@ class DynamicMMap : public MMap
       unsigned long Count;
    };
 
+   // The most a map can grow to, as offsets into it are map_ptrlocs
+   static constexpr size_t MaxLimit = sizeof(void *) < 8 ? 1024UL*1024*1024 :
+      static_cast<size_t>(std::numeric_limits<map_ptrloc>::max()) + 1;
+
    protected:
 
    FileFd *Fd;
    size_t WorkSpace;
+   size_t Limit;
+   unsigned long GrowCount;
    Pool *Pools;
    unsigned int PoolCount;
 
+   bool Reserve(size_t Size);
+   bool Commit(size_t NewWorkSpace);
+   bool Grow(size_t Needed);
+
    public:
 
+   // Number of times the workspace had to grow
+   inline unsigned long Growths() const {return GrowCount;}
+
    // Allocation
    std::optional<unsigned long> RawAllocate(size_t Size,size_t Aln = 0);
    std::optional<unsigned long> Allocate(size_t ItemSize);
@@ -105,8 +120,10 @@ class DynamicMMap : public MMap
    inline std::optional<unsigned long> WriteString(const string &S) {return WriteString(S.c_str(),S.length());}
    void UsePools(Pool &P,unsigned int const Count) {Pools = &P; PoolCount = Count;}
 
-   DynamicMMap(FileFd &F,unsigned long Flags,size_t RequestedWorkSpace = 2*1024*1024);
-   DynamicMMap(unsigned long Flags,size_t WorkSpace = 2*1024*1024);
+   DynamicMMap(FileFd &F,unsigned long Flags,size_t RequestedWorkSpace = 2*1024*1024,
+               size_t Limit = MaxLimit);
+   DynamicMMap(unsigned long Flags,size_t RequestedWorkSpace = 2*1024*1024,
+               size_t Limit = MaxLimit);
    virtual ~DynamicMMap();
 };
 
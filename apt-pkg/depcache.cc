@@ -31,6 +31,9 @@
 #include <unistd.h>
 
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 									/*}}}*/
 
@@ -38,7 +41,9 @@
 // ---------------------------------------------------------------------
 /* */
 pkgDepCache::pkgDepCache(pkgCache *pCache,Policy *Plcy) :
-                Cache(pCache), PkgState(0), DepState(0)
+                Cache(pCache), PkgState(0), DepState(0), Generation(0),
+                DebugUpdate(false), PkgJournalBase(0), DepJournalBase(0),
+                Serial(0), Written(0)
 {
    delLocalPolicy = 0;
    LocalPolicy = Plcy;
@@ -51,6 +56,7 @@ pkgDepCache::pkgDepCache(pkgCache *pCache,Policy *Plcy) :
 /* */
 pkgDepCache::~pkgDepCache()
 {
+   DropSnapshots();
    delete [] PkgState;
    delete [] DepState;
    delete delLocalPolicy;
@@ -61,6 +67,7 @@ pkgDepCache::~pkgDepCache()
 /* This allocats the extension buffers and initializes them. */
 bool pkgDepCache::Init(OpProgress *Prog)
 {
+   DropSnapshots();
    delete [] PkgState;
    delete [] DepState;
    // allocate and zero memory (for a struct with
@@ -69,6 +76,15 @@ bool pkgDepCache::Init(OpProgress *Prog)
    // allocate and zero memory
    DepState = new unsigned char[Head().DependsCount]();
 
+   PkgMark.assign(Head().PackageCount,0);
+   VerMark.assign(Head().VersionCount,0);
+   TargetMark.assign(Head().PackageCount,0);
+   PkgLogged.assign(Head().PackageCount,0);
+   DepLogged.assign(Head().DependsCount,0);
+   Serial = 0;
+   Generation = 0;
+   DebugUpdate = _config->FindB("Debug::pkgDepCache::Update",false);
+
    if (Prog != 0)
    {
       Prog->OverallProgress(0,2*Head().PackageCount,Head().PackageCount,
@@ -227,9 +243,10 @@ bool pkgDepCache::CheckDep(DepIterator Dep,int Type,PkgIterator &Res)
    PkgIterator Dep_ParentPkg = Dep.ParentPkg();
    pkgVersioningSystem &VS = this->VS();
 
-   static const char *lastV;
-   static const pkgCache::Dependency *lastD;
-   static bool lastRet;
+   // Per thread, since Update(OpProgress *) may run on several
+   static thread_local const char *lastV;
+   static thread_local const pkgCache::Dependency *lastD;
+   static thread_local bool lastRet;
 #define VS_CheckDep(V, D) \
    ({ \
       if (!(lastV == V && lastD == D)) { \
@@ -340,6 +357,12 @@ bool pkgDepCache::CheckDep(DepIterator Dep,int Type,PkgIterator &Res)
 // ---------------------------------------------------------------------
 /* Call with Mult = -1 to preform the inverse opration */
 void pkgDepCache::AddSizes(const PkgIterator &Pkg,signed long Mult)
+{
+   Totals T = {};
+   AddSizes(Pkg,T,Mult);
+   AddTotals(T);
+}
+void pkgDepCache::AddSizes(const PkgIterator &Pkg,Totals &To,signed long Mult)
 {
    StateCache &P = PkgState[Pkg->ID];
 
@@ -353,8 +376,8 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg,signed long Mult)
    // Compute the size data
    if (P.NewInstall() == true)
    {
-      iUsrSize += (signed long long)(Mult*P.InstVerIter(*this)->InstalledSize);
-      iDownloadSize += (signed long long)(Mult*P.InstVerIter(*this)->Size);
+      To.UsrSize += (signed long long)(Mult*P.InstVerIter(*this)->InstalledSize);
+      To.DownloadSize += (signed long long)(Mult*P.InstVerIter(*this)->Size);
       return;
    }
 
@@ -363,9 +386,9 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg,signed long Mult)
        (P.InstallVer != (Version *)Pkg.CurrentVer() ||
 	(P.iFlags & ReInstall) == ReInstall) && P.InstallVer != 0)
    {
-      iUsrSize += (signed long long)(Mult*((signed long long)P.InstVerIter(*this)->InstalledSize -
+      To.UsrSize += (signed long long)(Mult*((signed long long)P.InstVerIter(*this)->InstalledSize -
 			(signed long long)Pkg.CurrentVer()->InstalledSize));
-      iDownloadSize += (signed long long)(Mult*P.InstVerIter(*this)->Size);
+      To.DownloadSize += (signed long long)(Mult*P.InstVerIter(*this)->Size);
       return;
    }
 
@@ -373,14 +396,14 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg,signed long Mult)
    if (Pkg.State() == pkgCache::PkgIterator::NeedsUnpack &&
        P.Delete() == false)
    {
-      iDownloadSize += (signed long long)(Mult*P.InstVerIter(*this)->Size);
+      To.DownloadSize += (signed long long)(Mult*P.InstVerIter(*this)->Size);
       return;
    }
 
    // Removing
    if (Pkg->CurrentVer != 0 && P.InstallVer == 0)
    {
-      iUsrSize -= (signed long long)(Mult*Pkg.CurrentVer()->InstalledSize);
+      To.UsrSize -= (signed long long)(Mult*Pkg.CurrentVer()->InstalledSize);
       return;
    }
 }
@@ -394,26 +417,32 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg,signed long Mult)
    while processing a dep for Pkg it is possible that Add/Remove
    will be called on Pkg */
 void pkgDepCache::AddStates(const PkgIterator &Pkg,int Add)
+{
+   Totals T = {};
+   AddStates(Pkg,T,Add);
+   AddTotals(T);
+}
+void pkgDepCache::AddStates(const PkgIterator &Pkg,Totals &To,int Add)
 {
    StateCache &State = PkgState[Pkg->ID];
 
    // The Package is broken
    if ((State.DepState & DepInstMin) != DepInstMin)
-      iBrokenCount += Add;
+      To.BrokenCount += Add;
 
    // Bad state
    if (Pkg.State() != PkgIterator::NeedsNothing)
-      iBadCount += Add;
+      To.BadCount += Add;
 
    // Not installed
    if (Pkg->CurrentVer == 0)
    {
       if (State.Mode == ModeDelete &&
 	  (State.iFlags | Purge) == Purge && Pkg.Purge() == false)
-	 iDelCount += Add;
+	 To.DelCount += Add;
 
       if (State.Mode == ModeInstall)
-	 iInstCount += Add;
+	 To.InstCount += Add;
       return;
    }
 
@@ -421,21 +450,21 @@ void pkgDepCache::AddStates(const PkgIterator &Pkg,int Add)
    if (State.Status == 0)
    {
       if (State.Mode == ModeDelete)
-	 iDelCount += Add;
+	 To.DelCount += Add;
       else
 	 if ((State.iFlags & ReInstall) == ReInstall)
-	    iInstCount += Add;
+	    To.InstCount += Add;
 
       return;
    }
 
    // Alll 3 are possible
    if (State.Mode == ModeDelete)
-      iDelCount += Add;
+      To.DelCount += Add;
    if (State.Mode == ModeKeep)
-      iKeepCount += Add;
+      To.KeepCount += Add;
    if (State.Mode == ModeInstall)
-      iInstCount += Add;
+      To.InstCount += Add;
 }
 									/*}}}*/
 // DepCache::BuildGroupOrs - Generate the Or group dep data		/*{{{*/
@@ -449,7 +478,7 @@ void pkgDepCache::BuildGroupOrs(VerIterator const &V)
    for (DepIterator D = V.DependsList(); D.end() != true; D++)
    {
       // Build the dependency state.
-      unsigned char &State = DepState[D->ID];
+      unsigned char &State = DepWrite(D->ID);
 
       /* Invert for Conflicts. We have to do this twice to get the
          right sense for a conflicts group */
@@ -544,7 +573,7 @@ unsigned char pkgDepCache::DependencyState(DepIterator &D)
 void pkgDepCache::UpdateVerState(PkgIterator Pkg)
 {
    // Empty deps are always true
-   StateCache &State = PkgState[Pkg->ID];
+   StateCache &State = PkgWrite(Pkg->ID);
    State.DepState = 0xFF;
 
    // Check the Current state
@@ -571,10 +600,47 @@ void pkgDepCache::UpdateVerState(PkgIterator Pkg)
    }
 }
 									/*}}}*/
+// DepCache::UpdateAll - Figure out the state information of a package	/*{{{*/
+// ---------------------------------------------------------------------
+/* This only writes the state of Pkg and of the dependencies of its
+   versions, so that packages can be done on several threads at once, each
+   with its own counters. */
+void pkgDepCache::UpdateAll(PkgIterator const &Pkg,Totals &To)
+{
+   for (VerIterator V = Pkg.VersionList(); V.end() != true; V++)
+   {
+      unsigned char Group = 0;
+
+      for (DepIterator D = V.DependsList(); D.end() != true; D++)
+      {
+	 // Build the dependency state.
+	 unsigned char &State = DepWrite(D->ID);
+	 State = DependencyState(D);
+
+	 // Add to the group if we are within an or..
+	 Group |= State;
+	 State |= Group << 3;
+	 if ((D->CompareOp & Dep::Or) != Dep::Or)
+	    Group = 0;
+
+	 // Invert for Conflicts
+	 if (D->Type == Dep::Conflicts || D->Type == Dep::Obsoletes)
+	    State = ~State;
+      }
+   }
+
+   // Compute the pacakge dependency state and size additions
+   AddSizes(Pkg,To,1);
+   UpdateVerState(Pkg);
+   AddStates(Pkg,To,1);
+}
+									/*}}}*/
 // DepCache::Update - Figure out all the state information		/*{{{*/
 // ---------------------------------------------------------------------
 /* This will figure out the state of all the packages and all the
-   dependencies based on the current policy. */
+   dependencies based on the current policy. With APT::DepCache-Threads
+   above 1 the packages are shared out in small runs between that many
+   threads, whose counters are added up at the end. */
 void pkgDepCache::Update(OpProgress *Prog)
 {
    iUsrSize = 0;
@@ -585,42 +651,67 @@ void pkgDepCache::Update(OpProgress *Prog)
    iBrokenCount = 0;
    iBadCount = 0;
 
-   // Perform the depends pass
-   int Done = 0;
-   for (PkgIterator I = PkgBegin(); I.end() != true; I++,Done++)
+   unsigned long Threads = _config->FindI("APT::DepCache-Threads",1);
+   unsigned long Share = _config->FindI("APT::DepCache-Threads::Min-Packages",1000);
+   if (Share == 0)
+      Share = 1;
+   if (Threads > Head().PackageCount/Share)
+      Threads = Head().PackageCount/Share;
+   // The journal of the snapshots is not for several threads
+   if (Threads <= 1 || Snapshots.empty() == false || Written != 0)
    {
-      if (Prog != 0 && Done%20 == 0)
-	 Prog->Progress(Done);
-      for (VerIterator V = I.VersionList(); V.end() != true; V++)
+      // Perform the depends pass
+      Totals T = {};
+      int Done = 0;
+      for (PkgIterator I = PkgBegin(); I.end() != true; I++,Done++)
       {
-	 unsigned char Group = 0;
-
-	 for (DepIterator D = V.DependsList(); D.end() != true; D++)
-	 {
-	    // Build the dependency state.
-	    unsigned char &State = DepState[D->ID];
-	    State = DependencyState(D);
-
-	    // Add to the group if we are within an or..
-	    Group |= State;
-	    State |= Group << 3;
-	    if ((D->CompareOp & Dep::Or) != Dep::Or)
-	       Group = 0;
-
-	    // Invert for Conflicts
-	    if (D->Type == Dep::Conflicts || D->Type == Dep::Obsoletes)
-	       State = ~State;
-	 }
+	 if (Prog != 0 && Done%20 == 0)
+	    Prog->Progress(Done);
+	 UpdateAll(I,T);
       }
+      AddTotals(T);
 
-      // Compute the pacakge dependency state and size additions
-      AddSizes(I);
-      UpdateVerState(I);
-      AddStates(I);
+      if (Prog != 0)
+	 Prog->Progress(Done);
+      return;
    }
 
+   std::vector<Package *> Pkgs;
+   Pkgs.reserve(Head().PackageCount);
+   for (PkgIterator I = PkgBegin(); I.end() != true; I++)
+      Pkgs.push_back(I);
+
+   static const std::vector<Package *>::size_type Run = 256;
+   std::atomic<std::vector<Package *>::size_type> Next(0);
+   std::vector<Totals> Sums(Threads,Totals());
+   auto Work = [this,&Pkgs,&Next](Totals &To,OpProgress *Prog) {
+      while (true)
+      {
+	 std::vector<Package *>::size_type Start = Next.fetch_add(Run);
+	 if (Start >= Pkgs.size())
+	    return;
+	 if (Prog != 0)
+	    Prog->Progress(Start);
+	 std::vector<Package *>::size_type End = std::min(Start + Run,Pkgs.size());
+	 for (std::vector<Package *>::size_type I = Start; I != End; I++)
+	    UpdateAll(PkgIterator(*Cache,Pkgs[I]),To);
+      }
+   };
+
+   // This thread takes its share too, and reports the progress
+   std::vector<std::thread> Workers;
+   for (unsigned long I = 1; I != Threads; I++)
+      Workers.push_back(std::thread(Work,std::ref(Sums[I]),(OpProgress *)0));
+   Work(Sums[0],Prog);
+   for (std::vector<std::thread>::iterator I = Workers.begin();
+	I != Workers.end(); I++)
+      I->join();
+
+   for (std::vector<Totals>::const_iterator I = Sums.begin(); I != Sums.end(); ++I)
+      AddTotals(*I);
+
    if (Prog != 0)
-      Prog->Progress(Done);
+      Prog->Progress(Pkgs.size());
 }
 									/*}}}*/
 // DepCache::Update - Update the deps list of a package	   		/*{{{*/
@@ -632,7 +723,7 @@ void pkgDepCache::Update(DepIterator D)
    // Update the reverse deps
    for (;D.end() != true; D++)
    {
-      unsigned char &State = DepState[D->ID];
+      unsigned char &State = DepWrite(D->ID);
       State = DependencyState(D);
 
       // Invert for Conflicts
@@ -646,10 +737,53 @@ void pkgDepCache::Update(DepIterator D)
    }
 }
 									/*}}}*/
+// DepCache::UpdateRevDepends - Queue the deps on a changed package	/*{{{*/
+// ---------------------------------------------------------------------
+/* The dependencies on Target are checked again and their versions and
+   packages queued, each once, for Update to combine. The Now result only
+   depends on the current versions, which never change here, so it is
+   kept. */
+void pkgDepCache::UpdateRevDepends(PkgIterator Target)
+{
+   if (TargetMark[Target->ID] == Generation)
+      return;
+   TargetMark[Target->ID] = Generation;
+
+   for (DepIterator D = Target.RevDependsList(); D.end() != true; D++)
+   {
+      const bool Invert = D->Type == Dep::Conflicts ||
+			  D->Type == Dep::Obsoletes;
+      unsigned char &State = DepWrite(D->ID);
+      unsigned char New = (Invert ? ~State : State) & DepNow;
+      if (CheckDep(D,InstallVersion) == true)
+	 New |= DepInstall;
+      if (CheckDep(D,CandidateVersion) == true)
+	 New |= DepCVer;
+      State = Invert ? ~New : New;
+
+      VerIterator V = D.ParentVer();
+      if (VerMark[V->ID] != Generation)
+      {
+	 VerMark[V->ID] = Generation;
+	 DirtyVers.push_back(V);
+      }
+      PkgIterator P = D.ParentPkg();
+      if (PkgMark[P->ID] != Generation)
+      {
+	 PkgMark[P->ID] = Generation;
+	 DirtyPkgs.push_back(P);
+      }
+   }
+}
+									/*}}}*/
 // DepCache::Update - Update the related deps of a package		/*{{{*/
 // ---------------------------------------------------------------------
 /* This is called whenever the state of a package changes. It updates
-   all cached dependencies related to this package. */
+   all cached dependencies related to this package: those on the package
+   itself and those on anything one of its versions provides, since its
+   install or candidate version may have been any of them. Each package
+   depending on them is then updated once, whatever the number of its
+   dependencies involved. */
 void pkgDepCache::Update(PkgIterator const &Pkg)
 {
    // Recompute the dep of the package
@@ -657,22 +791,75 @@ void pkgDepCache::Update(PkgIterator const &Pkg)
    UpdateVerState(Pkg);
    AddStates(Pkg);
 
+   if (++Generation == 0)
+   {
+      PkgMark.assign(PkgMark.size(),0);
+      VerMark.assign(VerMark.size(),0);
+      TargetMark.assign(TargetMark.size(),0);
+      Generation = 1;
+   }
+
    // Update the reverse deps
-   Update(Pkg.RevDependsList());
+   UpdateRevDepends(Pkg);
+   for (VerIterator V = Pkg.VersionList(); V.end() != true; V++)
+      for (PrvIterator P = V.ProvidesList(); P.end() != true; P++)
+	 UpdateRevDepends(P.ParentPkg());
+
+   for (std::vector<Version *>::const_iterator I = DirtyVers.begin();
+	I != DirtyVers.end(); ++I)
+      BuildGroupOrs(VerIterator(*Cache,*I));
+   for (std::vector<Package *>::const_iterator I = DirtyPkgs.begin();
+	I != DirtyPkgs.end(); ++I)
+   {
+      PkgIterator P(*Cache,*I);
+      RemoveStates(P);
+      UpdateVerState(P);
+      AddStates(P);
+   }
 
-   // Update the provides map for the current ver
-   if (Pkg->CurrentVer != 0)
-      for (PrvIterator P = Pkg.CurrentVer().ProvidesList();
-	   P.end() != true; P++)
-	 Update(P.ParentPkg().RevDependsList());
-
-   // Update the provides map for the candidate ver
-   if (PkgState[Pkg->ID].CandidateVer != 0)
-      for (PrvIterator P = PkgState[Pkg->ID].CandidateVerIter(*this).ProvidesList();
-	   P.end() != true; P++)
-	 Update(P.ParentPkg().RevDependsList());
-}
+   DirtyVers.clear();
+   DirtyPkgs.clear();
 
+   if (DebugUpdate == true)
+      CheckUpdate(Pkg);
+}
+									/*}}}*/
+// DepCache::CheckUpdate - Compare the state with a full recompute	/*{{{*/
+// ---------------------------------------------------------------------
+/* Debug::pkgDepCache::Update runs this after every Update(Pkg), telling
+   what the incremental update got wrong. The recomputed state is kept. */
+void pkgDepCache::CheckUpdate(PkgIterator const &Pkg)
+{
+   std::vector<unsigned char> OldDeps(DepState,DepState + Head().DependsCount);
+   std::vector<unsigned char> OldPkgs(Head().PackageCount);
+   for (unsigned long I = 0; I != Head().PackageCount; I++)
+      OldPkgs[I] = PkgState[I].DepState;
+   const unsigned long OldBroken = iBrokenCount;
+   const unsigned long OldInst = iInstCount;
+   const unsigned long OldDel = iDelCount;
+   const unsigned long OldKeep = iKeepCount;
+
+   Update((OpProgress *)0);
+
+   for (PkgIterator P = PkgBegin(); P.end() != true; P++)
+   {
+      if (OldPkgs[P->ID] != PkgState[P->ID].DepState)
+	 fprintf(stderr,"Update(%s): %s is %#x, %#x when recomputed\n",
+		 Pkg.Name(),P.Name(),OldPkgs[P->ID],PkgState[P->ID].DepState);
+      for (VerIterator V = P.VersionList(); V.end() != true; V++)
+	 for (DepIterator D = V.DependsList(); D.end() != true; D++)
+	    if (OldDeps[D->ID] != DepState[D->ID])
+	       fprintf(stderr,"Update(%s): %s of %s %s is %#x, "
+		       "%#x when recomputed\n",Pkg.Name(),D.TargetPkg().Name(),
+		       P.Name(),V.VerStr(),OldDeps[D->ID],DepState[D->ID]);
+   }
+   if (OldBroken != iBrokenCount || OldInst != iInstCount ||
+       OldDel != iDelCount || OldKeep != iKeepCount)
+      fprintf(stderr,"Update(%s): counts are %lu %lu %lu %lu, "
+	      "%lu %lu %lu %lu when recomputed\n",Pkg.Name(),
+	      OldBroken,OldInst,OldDel,OldKeep,
+	      iBrokenCount,iInstCount,iDelCount,iKeepCount);
+}
 									/*}}}*/
 
 // DepCache::MarkKeep - Put the package in the keep state		/*{{{*/
@@ -692,7 +879,7 @@ void pkgDepCache::MarkKeep(PkgIterator const &Pkg,bool Soft)
 
    /* We changed the soft state all the time so the UI is a bit nicer
       to use */
-   StateCache &P = PkgState[Pkg->ID];
+   StateCache &P = PkgWrite(Pkg->ID);
    if (Soft == true)
       P.iFlags |= AutoKept;
    else
@@ -734,7 +921,7 @@ void pkgDepCache::MarkDelete(PkgIterator const &Pkg, bool rPurge)
       return;
 
    // Check that it is not already marked for delete
-   StateCache &P = PkgState[Pkg->ID];
+   StateCache &P = PkgWrite(Pkg->ID);
    P.iFlags &= ~(AutoKept | Purge);
    if (rPurge == true)
       P.iFlags |= Purge;
@@ -765,7 +952,7 @@ void pkgDepCache::MarkDelete(PkgIterator const &Pkg, bool rPurge)
 
 void pkgDepCache::MarkAuto(const PkgIterator &Pkg, pkgDepCache::AutoMarkFlag AutoFlag)
 {
-   StateCache &state = PkgState[Pkg->ID];
+   StateCache &state = PkgWrite(Pkg->ID);
 
    switch (AutoFlag)
    {
@@ -807,7 +994,7 @@ int pkgDepCache::MarkInstall0(PkgIterator const &Pkg)
 
    /* Check that it is not already marked for install and that it can be
       installed */
-   StateCache &P = PkgState[Pkg->ID];
+   StateCache &P = PkgWrite(Pkg->ID);
    P.iFlags &= ~AutoKept;
    if (P.InstBroken() == false && (P.Mode == ModeInstall ||
 	P.CandidateVer == (Version *)Pkg.CurrentVer()))
@@ -1040,7 +1227,7 @@ void pkgDepCache::SetReInstall(PkgIterator const &Pkg,bool To)
    RemoveSizes(Pkg);
    RemoveStates(Pkg);
 
-   StateCache &P = PkgState[Pkg->ID];
+   StateCache &P = PkgWrite(Pkg->ID);
    if (To == true)
    {
       P.iFlags |= ReInstall;
@@ -1065,7 +1252,7 @@ void pkgDepCache::SetReInstall(PkgIterator const &Pkg,bool To)
 void pkgDepCache::SetCandidateVersion(VerIterator TargetVer)
 {
    pkgCache::PkgIterator Pkg = TargetVer.ParentPkg();
-   StateCache &P = PkgState[Pkg->ID];
+   StateCache &P = PkgWrite(Pkg->ID);
 
    RemoveSizes(Pkg);
    RemoveStates(Pkg);
@@ -1174,37 +1361,126 @@ bool pkgDepCache::Policy::IsImportantDep(DepIterator Dep)
 }
 									/*}}}*/
 
+// DepCache::LogPkg - Journal the state of a package			/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgDepCache::LogPkg(unsigned long ID)
+{
+   PkgLogged[ID] = Serial;
+   PkgUndo U = {ID,PkgState[ID]};
+   PkgJournal.push_back(U);
+}
+									/*}}}*/
+// DepCache::LogDep - Journal the state of a dependency			/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgDepCache::LogDep(unsigned long ID)
+{
+   DepLogged[ID] = Serial;
+   DepUndo U = {ID,DepState[ID]};
+   DepJournal.push_back(U);
+}
+									/*}}}*/
+// DepCache::TrimJournal - Drop what no snapshot can restore		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgDepCache::TrimJournal()
+{
+   unsigned long PkgMin = PkgJournalBase + PkgJournal.size();
+   unsigned long DepMin = DepJournalBase + DepJournal.size();
+   for (std::set<State *>::const_iterator I = Snapshots.begin();
+	I != Snapshots.end(); ++I)
+   {
+      PkgMin = std::min(PkgMin,(*I)->PkgPos);
+      DepMin = std::min(DepMin,(*I)->DepPos);
+   }
+
+   if (PkgMin - PkgJournalBase == PkgJournal.size())
+      PkgJournal.clear();
+   else
+      PkgJournal.erase(PkgJournal.begin(),
+		       PkgJournal.begin() + (PkgMin - PkgJournalBase));
+   PkgJournalBase = PkgMin;
+
+   if (DepMin - DepJournalBase == DepJournal.size())
+      DepJournal.clear();
+   else
+      DepJournal.erase(DepJournal.begin(),
+		       DepJournal.begin() + (DepMin - DepJournalBase));
+   DepJournalBase = DepMin;
+}
+									/*}}}*/
+// DepCache::DropSnapshots - Detach every snapshot from the depcache	/*{{{*/
+// ---------------------------------------------------------------------
+/* Done when the states are built again or go away, the snapshots then
+   having nothing left to restore. */
+void pkgDepCache::DropSnapshots()
+{
+   for (std::set<State *>::const_iterator I = Snapshots.begin();
+	I != Snapshots.end(); ++I)
+   {
+      (*I)->Dep = 0;
+      (*I)->Old.clear();
+   }
+   Snapshots.clear();
+   TrimJournal();
+}
+									/*}}}*/
+
 // CNC:2003-02-24
 // pkgDepCache::State::* - Routines to work on the state of a DepCache.	/*{{{*/
 // ---------------------------------------------------------------------
 /* */
 void pkgDepCache::State::Copy(pkgDepCache::State const &Other)
 {
-   memcpy(this, &Other, sizeof(*this));
-   int Size = Dep->Head().PackageCount;
-   int DepSize = Dep->Head().DependsCount;
-   PkgState = new StateCache[Size];
-   PkgIgnore = new bool[Size];
-   DepState = new unsigned char[DepSize];
-   memcpy(PkgState, Other.PkgState, Size*sizeof(*PkgState));
-   memcpy(PkgIgnore, Other.PkgIgnore, Size*sizeof(*PkgIgnore));
-   memcpy(DepState, Other.DepState, DepSize*sizeof(*DepState));
+   Dep = Other.Dep;
+   PkgPos = Other.PkgPos;
+   DepPos = Other.DepPos;
+   iUsrSize = Other.iUsrSize;
+   iDownloadSize = Other.iDownloadSize;
+   iInstCount = Other.iInstCount;
+   iDelCount = Other.iDelCount;
+   iKeepCount = Other.iKeepCount;
+   iBrokenCount = Other.iBrokenCount;
+   iBadCount = Other.iBadCount;
+   PkgIgnore = Other.PkgIgnore;
+   Old = Other.Old;
+   OldEnd = Other.OldEnd;
+   if (Dep != NULL)
+      Dep->Snapshots.insert(this);
+}
+
+void pkgDepCache::State::Release()
+{
+   if (Dep != NULL)
+   {
+      Dep->Snapshots.erase(this);
+      Dep->TrimJournal();
+      Dep = NULL;
+   }
+   Old.clear();
 }
 
 void pkgDepCache::State::Save(pkgDepCache *dep)
 {
+   Release();
    Dep = dep;
-   delete[] PkgState;
-   delete[] DepState;
-   delete[] PkgIgnore;
-   int Size = Dep->Head().PackageCount;
-   int DepSize = Dep->Head().DependsCount;
-   PkgState = new StateCache[Size];
-   // allocate and zero memory
-   PkgIgnore = new bool[Size]();
-   DepState = new unsigned char[DepSize];
-   memcpy(PkgState, Dep->PkgState, Size*sizeof(*PkgState));
-   memcpy(DepState, Dep->DepState, DepSize*sizeof(*DepState));
+   if (Dep == NULL)
+      return;
+
+   // Changes from now on are journaled again, even if they were already
+   if (++Dep->Serial == 0)
+   {
+      Dep->PkgLogged.assign(Dep->PkgLogged.size(),0);
+      Dep->DepLogged.assign(Dep->DepLogged.size(),0);
+      Dep->Serial = 1;
+   }
+   PkgPos = Dep->PkgJournalBase + Dep->PkgJournal.size();
+   DepPos = Dep->DepJournalBase + Dep->DepJournal.size();
+   OldEnd = PkgPos;
+   PkgIgnore.clear();
+   Dep->Snapshots.insert(this);
+
    iUsrSize = Dep->iUsrSize;
    iDownloadSize= Dep->iDownloadSize;
    iInstCount = Dep->iInstCount;
@@ -1214,10 +1490,28 @@ void pkgDepCache::State::Save(pkgDepCache *dep)
    iBadCount = Dep->iBadCount;
 }
 
+// The journal is undone newest first, so the value at the snapshot is
+// the one left. Undoing is a change as well, journaled for the others.
 void pkgDepCache::State::Restore()
 {
-   memcpy(Dep->PkgState, PkgState, Dep->Head().PackageCount*sizeof(*PkgState));
-   memcpy(Dep->DepState, DepState, Dep->Head().DependsCount*sizeof(*DepState));
+   if (Dep == NULL)
+      return;
+
+   for (unsigned long I = Dep->PkgJournalBase + Dep->PkgJournal.size();
+	I != PkgPos;)
+   {
+      --I;
+      const PkgUndo U = Dep->PkgJournal[I - Dep->PkgJournalBase];
+      Dep->PkgWrite(U.ID) = U.Old;
+   }
+   for (unsigned long I = Dep->DepJournalBase + Dep->DepJournal.size();
+	I != DepPos;)
+   {
+      --I;
+      const DepUndo U = Dep->DepJournal[I - Dep->DepJournalBase];
+      Dep->DepWrite(U.ID) = U.Old;
+   }
+
    Dep->iUsrSize = iUsrSize;
    Dep->iDownloadSize= iDownloadSize;
    Dep->iInstCount = iInstCount;
@@ -1227,22 +1521,60 @@ void pkgDepCache::State::Restore()
    Dep->iBadCount = iBadCount;
 }
 
+// The first entry of a package after the snapshot holds its state then
+void pkgDepCache::State::ReadJournal()
+{
+   const unsigned long End = Dep->PkgJournalBase + Dep->PkgJournal.size();
+   for (; OldEnd != End; OldEnd++)
+   {
+      const PkgUndo &U = Dep->PkgJournal[OldEnd - Dep->PkgJournalBase];
+      Old.emplace(U.ID,U.Old);
+   }
+}
+
+const pkgDepCache::StateCache &
+pkgDepCache::State::operator [](pkgCache::PkgIterator const &I)
+{
+   static const StateCache None = StateCache();
+   if (Dep == NULL)
+      return None;
+
+   ReadJournal();
+   std::unordered_map<unsigned long,StateCache>::const_iterator S =
+      Old.find(I->ID);
+   if (S != Old.end())
+      return S->second;
+   return Dep->PkgState[I->ID];
+}
+
 bool pkgDepCache::State::Changed()
 {
-   int Size = Dep->Head().PackageCount;
+   if (Dep == NULL)
+      return false;
+
+   ReadJournal();
    StateCache *NewPkgState = Dep->PkgState;
-   for (int i = 0; i != Size; i++) {
-      if (PkgIgnore[i] == false &&
-          ((PkgState[i].Status != NewPkgState[i].Status) ||
-          (PkgState[i].Mode != NewPkgState[i].Mode)))
+   for (std::unordered_map<unsigned long,StateCache>::const_iterator I = Old.begin();
+	I != Old.end(); ++I) {
+      if ((I->first >= PkgIgnore.size() || PkgIgnore[I->first] == false) &&
+          ((I->second.Status != NewPkgState[I->first].Status) ||
+          (I->second.Mode != NewPkgState[I->first].Mode)))
          return true;
    }
    return false;
 }
 
-void pkgDepCache::State::UnIgnoreAll()
+void pkgDepCache::State::Ignore(PkgIterator const &I)
+{
+   if (I->ID >= PkgIgnore.size())
+      PkgIgnore.resize(I->ID + 1,false);
+   PkgIgnore[I->ID] = true;
+}
+
+void pkgDepCache::State::UnIgnore(PkgIterator const &I)
 {
-   memset(PkgIgnore, 0, Dep->Head().PackageCount*sizeof(*PkgIgnore));
+   if (I->ID < PkgIgnore.size())
+      PkgIgnore[I->ID] = false;
 }
 
 									/*}}}*/
@@ -38,6 +38,9 @@
 #define PKGLIB_DEPCACHE_H
 
 #include <set>
+#include <vector>
+#include <deque>
+#include <unordered_map>
 
 #include <apt-pkg/pkgcache.h>
 #include <apt-pkg/progress.h>
@@ -58,6 +61,10 @@ class pkgDepCache : protected pkgCache::Namespace
    // These flags are used in StateCache::iFlags
    enum InternalFlags {AutoKept = (1 << 0), Purge = (1 << 1), ReInstall = (1 << 2)};
 
+   // CNC:2003-02-23 - See below.
+   class State;
+   friend class State;
+
    enum VersionTypes {NowVersion, InstallVersion, CandidateVersion};
    enum ModeList {ModeDelete = 0, ModeKeep = 1, ModeInstall = 2};
 
@@ -146,6 +153,68 @@ class pkgDepCache : protected pkgCache::Namespace
    Policy *delLocalPolicy;           // For memory clean up..
    Policy *LocalPolicy;
 
+   /* Work lists of Update(PkgIterator), kept to spare allocations. A
+      package or version is queued, and a target visited, when its mark
+      equals the current generation. */
+   std::vector<unsigned long> PkgMark;
+   std::vector<unsigned long> VerMark;
+   std::vector<unsigned long> TargetMark;
+   unsigned long Generation;
+   std::vector<Version *> DirtyVers;
+   std::vector<Package *> DirtyPkgs;
+   bool DebugUpdate;
+
+   void UpdateRevDepends(PkgIterator Target);
+   void CheckUpdate(PkgIterator const &Pkg);
+
+   /* The undo journal of the State snapshots. While any is taken, the
+      first change to a package or dependency state after the latest
+      Save() records its previous value. Positions in the journals count
+      from the start of the session, the entries before the oldest
+      snapshot being dropped. */
+   struct PkgUndo
+   {
+      unsigned long ID;
+      StateCache Old;
+   };
+   struct DepUndo
+   {
+      unsigned long ID;
+      unsigned char Old;
+   };
+   std::deque<PkgUndo> PkgJournal;
+   std::deque<DepUndo> DepJournal;
+   unsigned long PkgJournalBase;
+   unsigned long DepJournalBase;
+   std::vector<unsigned int> PkgLogged;
+   std::vector<unsigned int> DepLogged;
+   unsigned int Serial;
+   std::set<State *> Snapshots;
+
+   void LogPkg(unsigned long ID);
+   void LogDep(unsigned long ID);
+   void TrimJournal();
+   void DropSnapshots();
+
+   // Gets the ID of each package state written, while set
+   std::vector<unsigned long> *Written;
+
+   // Every change to the states goes through these
+   inline StateCache &PkgWrite(unsigned long ID)
+   {
+      if (Snapshots.empty() == false && PkgLogged[ID] != Serial)
+	 LogPkg(ID);
+      if (Written != 0)
+	 Written->push_back(ID);
+      return PkgState[ID];
+   }
+   inline unsigned char &DepWrite(unsigned long ID)
+   {
+      if (Snapshots.empty() == false && DepLogged[ID] != Serial)
+	 LogDep(ID);
+      return DepState[ID];
+   }
+
    // Check for a matching provides
    bool CheckDep(DepIterator Dep,int Type,PkgIterator &Res);
    inline bool CheckDep(DepIterator Dep,int Type)
@@ -164,18 +233,30 @@ class pkgDepCache : protected pkgCache::Namespace
    void Update(DepIterator Dep);           // Mostly internal
    void Update(PkgIterator const &P);
 
+   // The counters, summed apart on each thread of Update(OpProgress *)
+   struct Totals
+   {
+      double UsrSize;
+      double DownloadSize;
+      unsigned long InstCount;
+      unsigned long DelCount;
+      unsigned long KeepCount;
+      unsigned long BrokenCount;
+      unsigned long BadCount;
+   };
+   void AddTotals(Totals const &T);
+   void UpdateAll(PkgIterator const &Pkg,Totals &To);
+
    // Count manipulators
+   void AddSizes(const PkgIterator &Pkg,Totals &To,signed long Mult);
    void AddSizes(const PkgIterator &Pkg,signed long Mult = 1);
    inline void RemoveSizes(const PkgIterator &Pkg) {AddSizes(Pkg,-1);}
+   void AddStates(const PkgIterator &Pkg,Totals &To,int Add);
    void AddStates(const PkgIterator &Pkg,int Add = 1);
    inline void RemoveStates(const PkgIterator &Pkg) {AddStates(Pkg,-1);}
 
    public:
 
-   // CNC:2003-02-23 - See below.
-   class State;
-   friend class State;
-
    // Legacy.. We look like a pkgCache
    inline operator pkgCache &() {return *Cache;}
    inline Header &Head() {return *Cache->HeaderP;}
@@ -225,6 +306,11 @@ class pkgDepCache : protected pkgCache::Namespace
    // This is for debuging
    void Update(OpProgress *Prog = 0);
 
+   /* Appends to Written the ID of every package whose state may change
+      from now on, duplicates included, until called with 0 */
+   inline void TrackWrites(std::vector<unsigned long> *Written)
+      {this->Written = Written;}
+
    // Size queries
    inline double UsrSize() {return iUsrSize;}
    inline double DebSize() {return iDownloadSize;}
@@ -241,14 +327,19 @@ class pkgDepCache : protected pkgCache::Namespace
 };
 
 // CNC:2003-02-24 - Class to work on the state of a depcache.
+/* A snapshot only keeps where the journals of the depcache stood when it
+   was taken, so taking, restoring and comparing it costs as much as the
+   changes made since. Snapshots may be nested and restored in any order,
+   as often as needed. They stop working when the depcache is built again
+   or destroyed. */
 class pkgDepCache::State
 {
    protected:
 
    pkgDepCache *Dep;
 
-   StateCache *PkgState;
-   unsigned char *DepState;
+   unsigned long PkgPos;
+   unsigned long DepPos;
    double iUsrSize;
    double iDownloadSize;
    unsigned long iInstCount;
@@ -257,7 +348,15 @@ class pkgDepCache::State
    unsigned long iBrokenCount;
    unsigned long iBadCount;
 
-   bool *PkgIgnore;
+   std::vector<bool> PkgIgnore;
+
+   // The package states at the snapshot, read from the journal so far
+   std::unordered_map<unsigned long,StateCache> Old;
+   unsigned long OldEnd;
+   void ReadJournal();
+
+   friend class pkgDepCache;
+   void Release();
 
    public:
 
@@ -265,12 +364,13 @@ class pkgDepCache::State
    void Restore();
    bool Changed();
 
-   void Ignore(PkgIterator const &I) {PkgIgnore[I->ID] = true;}
-   void UnIgnore(PkgIterator const &I) {PkgIgnore[I->ID] = false;}
-   bool Ignored(PkgIterator const &I) {return PkgIgnore[I->ID];}
-   void UnIgnoreAll();
+   void Ignore(PkgIterator const &I);
+   void UnIgnore(PkgIterator const &I);
+   bool Ignored(PkgIterator const &I)
+      {return I->ID < PkgIgnore.size() && PkgIgnore[I->ID];}
+   void UnIgnoreAll() {PkgIgnore.clear();}
 
-   StateCache &operator [](pkgCache::PkgIterator const &I) {return PkgState[I->ID];}
+   const StateCache &operator [](pkgCache::PkgIterator const &I);
 
    // Size queries
    inline double UsrSize() {return iUsrSize;}
@@ -284,22 +384,20 @@ class pkgDepCache::State
    void Copy(State const &Other);
    void operator =(State const &Other)
       {
-	 delete[] PkgState;
-	 delete[] DepState;
-	 delete[] PkgIgnore;
-	 Copy(Other);
+	 if (this != &Other)
+	 {
+	    Release();
+	    Copy(Other);
+	 }
       }
    State(const State &Other)
+	 : Dep(0)
       { Copy(Other); }
    State(pkgDepCache *Dep=NULL)
-	 : Dep(0), PkgState(0), DepState(0), PkgIgnore(0)
+	 : Dep(0)
       { if (Dep != NULL) Save(Dep); }
    ~State()
-      {
-	 delete[] PkgState;
-	 delete[] DepState;
-	 delete[] PkgIgnore;
-      }
+      { Release(); }
 };
 
 
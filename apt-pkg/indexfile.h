@@ -77,6 +77,13 @@ class pkgIndexFile
    virtual bool MergeFileProvides(pkgCacheGenerator &/*Gen*/,OpProgress &/*Prog*/) const {return true;}
    virtual pkgCache::PkgFileIterator FindInCache(pkgCache &Cache) const;
 
+   /* Decode the index ahead of Merge(), possibly on another thread, so
+      that Merge() only has to insert. It must not touch the cache or
+      report errors; if anything goes wrong Merge() simply does the work
+      itself. */
+   virtual void Preparse() const {}
+   virtual void DropPreparsed() const {}
+
    virtual ~pkgIndexFile() {}
 };
 
@@ -881,6 +881,10 @@ static int AptLua_pkgsummary(lua_State *L)
       pkgCache *Cache = _lua->GetCache(L);
       if (Cache == NULL)
 	 return 0;
+      if (PkgI->VersionList().Summary() != NULL) {
+	 lua_pushstring(L, PkgI->VersionList().Summary());
+	 return 1;
+      }
       pkgRecords Recs(*Cache);
       pkgRecords::Parser &Parse =
 			      Recs.Lookup(PkgI->VersionList().FileList());
@@ -900,6 +904,10 @@ static int AptLua_pkgdescr(lua_State *L)
       pkgCache *Cache = _lua->GetCache(L);
       if (Cache == NULL)
 	 return 0;
+      if (PkgI->VersionList().Description() != NULL) {
+	 lua_pushstring(L, PkgI->VersionList().Description());
+	 return 1;
+      }
       pkgRecords Recs(*Cache);
       pkgRecords::Parser &Parse = Recs.Lookup(PkgI->VersionList().FileList());
       lua_pushstring(L, Parse.LongDesc().c_str());
@@ -51,12 +51,13 @@ pkgCache::Header::Header()
    /* Whenever the structures change the major version should be bumped,
       whenever the generator changes the minor version should be bumped. */
    // CNC:2003-11-24
-   MajorVersion = 6;
+   MajorVersion = 11;
    MinorVersion = 0;
    Dirty = false;
 
    // CNC:2003-03-18
    HasFileDeps = false;
+   MovedVersions = false;
 
    // CNC:2003-11-24
    OptionsHash = 0;
@@ -76,12 +77,17 @@ pkgCache::Header::Header()
    VerFileCount = 0;
    ProvidesCount = 0;
    MaxVerFileSize = 0;
+   DroppedSize = 0;
+   MapGrowths = 0;
+   InternHits = 0;
+   InternMisses = 0;
 
    FileList = 0;
    StringList = 0;
    VerSysName = 0;
    Architecture = 0;
-   memset(HashTable,0,sizeof(HashTable));
+   HashTable = 0;
+   HashTableSize = 0;
    memset(Pools,0,sizeof(Pools));
 }
 									/*}}}*/
@@ -129,6 +135,7 @@ bool pkgCache::ReMap()
 
    if (Map.Size() == 0 || HeaderP == 0)
       return _error->Error(_("Empty package cache"));
+   HashTableP = (map_ptrloc *)(StrP + HeaderP->HashTable);
 
    // Check the header
    Header DefHeader;
@@ -194,7 +201,7 @@ pkgCache::PkgIterator pkgCache::FindPkg(const string & Name)
 pkgCache::Package *pkgCache::FindPackage(const char *Name)
 {
    // Look at the hash bucket
-   Package *Pkg = PkgP + HeaderP->HashTable[Hash(Name)];
+   Package *Pkg = PkgP + HashTableP[Hash(Name)];
    for (; Pkg != PkgP; Pkg = PkgP + Pkg->NextPackage)
    {
       // CNC:2003-02-17 - We use case sensitive package names.
@@ -272,10 +279,10 @@ void pkgCache::PkgIterator::operator ++(int)
       Pkg = Owner->PkgP + Pkg->NextPackage;
 
    // Follow the hash table
-   while (Pkg == Owner->PkgP && (HashIndex+1) < (signed)_count(Owner->HeaderP->HashTable))
+   while (Pkg == Owner->PkgP && (HashIndex+1) < (signed)Owner->HeaderP->HashTableSize)
    {
       HashIndex++;
-      Pkg = Owner->PkgP + Owner->HeaderP->HashTable[HashIndex];
+      Pkg = Owner->PkgP + Owner->HashTableP[HashIndex];
    }
 }
 									/*}}}*/
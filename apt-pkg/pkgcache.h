@@ -19,6 +19,7 @@
 #define PKGLIB_PKGCACHE_H
 
 #include <string>
+#include <cstdint>
 #include <time.h>
 #include <apt-pkg/mmap.h>
 
@@ -119,6 +120,7 @@ class pkgCache
    Dependency *DepP;
    StringItem *StringItemP;
    char *StrP;
+   map_ptrloc *HashTableP;
 
    virtual bool ReMap();
    inline bool Sync() {return Map.Sync();}
@@ -166,6 +168,10 @@ struct pkgCache::Header
    // CNC:2003-03-18
    bool HasFileDeps;
 
+   // Versions were moved to other packages after being merged, so the
+   // package files can't be dropped one by one (see DropFiles)
+   bool MovedVersions;
+
    // CNC:2003-11-24
    unsigned long OptionsHash;
 
@@ -193,12 +199,24 @@ struct pkgCache::Header
    map_ptrloc Architecture;          // StringTable
    unsigned long MaxVerFileSize;
 
+   // Space left unreachable by dropping package files
+   unsigned long DroppedSize;
+
+   // Times the map had to grow while the cache was generated
+   unsigned long MapGrowths;
+
+   // Strings found already written, and written, by the generator
+   unsigned long InternHits;
+   unsigned long InternMisses;
+
    /* Allocation pools, there should be one of these for each structure
       excluding the header */
    DynamicMMap::Pool Pools[7];
 
-   // Rapid package name lookup
-   map_ptrloc HashTable[64*1024];
+   /* Rapid package name lookup, HashTableSize (a power of two) buckets.
+      The generator doubles it as packages are added. */
+   map_ptrloc HashTable;             // map_ptrloc[HashTableSize]
+   unsigned long HashTableSize;
 
    bool CheckSizes(Header &Against) const;
    Header();
@@ -262,6 +280,11 @@ struct pkgCache::Version
    map_ptrloc Section;           // StringTable (StringItem)
    map_ptrloc Arch;              // StringTable
 
+   // Only kept with APT::Cache-Texts, 0 otherwise
+   map_ptrloc Summary;           // Stringtable
+   map_ptrloc Description;       // Stringtable
+   map_ptrloc Packager;          // Stringtable
+
    // Lists
    map_ptrloc FileList;          // VerFile
    map_ptrloc NextVer;           // Version
@@ -312,20 +335,20 @@ struct pkgCache::StringItem
 #include <apt-pkg/cacheiterators.h>
 
 // CNC:2003-02-16 - Inlined here.
+/* This is 64 bit FNV-1a. The high half is folded into the low one, as only
+   the low bits are used to pick a bucket. */
 inline unsigned long pkgCache::sHash(const char *S) const
 {
-   unsigned long h = 5381;
+   uint64_t h = 14695981039346656037ULL;
    unsigned char c;
    for (c = *S; c != '\0'; c = *++S)
-      h = h * 33 + c;
-   return h;
+      h = (h ^ c) * 1099511628211ULL;
+   return h ^ (h >> 32);
 }
-#define hash_count(a) (sizeof(a)/sizeof(a[0]))
 inline unsigned long pkgCache::Hash(const char *S) const
 {
-   return sHash(S) % hash_count(HeaderP->HashTable);
+   return sHash(S) & (HeaderP->HashTableSize - 1);
 }
-#undef hash_count
 
 inline pkgCache::PkgIterator pkgCache::PkgBegin()
        {return PkgIterator(*this);}
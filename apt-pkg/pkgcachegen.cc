@@ -26,6 +26,11 @@
 #include <apti18n.h>
 
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <sys/stat.h>
 #include <unistd.h>
@@ -36,20 +41,20 @@
 
 typedef vector<pkgIndexFile *>::iterator FileIterator;
 
+/* Buckets of the package hash table of a new cache, it is doubled
+   whenever there are more packages than buckets */
+constexpr unsigned long InitialHashTableSize = 4096;
+
 // TODO: FindI() takes and returns int, which is inappropriate in many places.
 /* The default value used in pkgMake{,Only}StatusCache */
 constexpr unsigned long defaultCacheLimit =
    (sizeof(long) < 8 ? 5 : 6) * 32 * 1024 * 1024;
 
-static unsigned long getConfiguredCacheLimit(const char * const Function)
+/* Only the size the map starts with, since it grows when that is not
+   enough; a lower value costs some growths, not a failure. */
+static unsigned long getConfiguredCacheLimit()
 {
-   const unsigned long MapSize = _config->FindI("APT::Cache-Limit",defaultCacheLimit);
-   if (MapSize < defaultCacheLimit)
-      _error->Warning("%s: The configured APT::Cache-Limit (%lu) is below the recommended default value (%lu). Remove it to use the default.",
-                      Function,
-                      MapSize,
-                      defaultCacheLimit);
-   return MapSize;
+   return _config->FindI("APT::Cache-Limit",defaultCacheLimit);
 }
 
 // CacheGenerator::pkgCacheGenerator - Constructor			/*{{{*/
@@ -57,10 +62,9 @@ static unsigned long getConfiguredCacheLimit(const char * const Function)
 /* We set the diry flag and make sure that is written to the disk */
 pkgCacheGenerator::pkgCacheGenerator(DynamicMMap &aMap,OpProgress *Prog) :
 		    Map(aMap), Cache(aMap,false), Progress(Prog),
-		    FoundFileDeps(0)
+		    FoundFileDeps(0), FoundNewFileDeps(false), FileDepsCount(0)
 {
    CurrentFile = 0;
-   memset(UniqHash,0,sizeof(UniqHash));
 
    if (_error->PendingError() == true)
       return;
@@ -68,20 +72,24 @@ pkgCacheGenerator::pkgCacheGenerator(DynamicMMap &aMap,OpProgress *Prog) :
    if (Map.Size() == 0)
    {
       const auto idxBeginning = Map.RawAllocate(sizeof(pkgCache::Header));
-      const auto idxVerSysName = WriteStringInMap(_system->VS->Label);
-      const auto idxArch = WriteStringInMap(_config->Find("APT::Architecture"));
-      if ((!idxBeginning) || (!idxVerSysName) || (!idxArch))
+      if (!idxBeginning)
          return;
 
       // Setup the map interface..
       Cache.HeaderP = reinterpret_cast<pkgCache::Header *>(static_cast<char *>(Map.Data()) + *idxBeginning);
       Map.UsePools(*Cache.HeaderP->Pools,sizeof(Cache.HeaderP->Pools)/sizeof(Cache.HeaderP->Pools[0]));
 
-      // Starting header
+      // Starting header, which must be there to count the strings
       *Cache.HeaderP = pkgCache::Header();
+      const auto idxVerSysName = WriteStringInMap(_system->VS->Label);
+      const auto idxArch = WriteStringInMap(_config->Find("APT::Architecture"));
+      if ((!idxVerSysName) || (!idxArch))
+         return;
       Cache.HeaderP->VerSysName = *idxVerSysName;
       Cache.HeaderP->Architecture = *idxArch;
       Cache.ReMap();
+      if (ResizeHashTable(InitialHashTableSize) == false)
+	 return;
    }
    else
    {
@@ -93,6 +101,15 @@ pkgCacheGenerator::pkgCacheGenerator(DynamicMMap &aMap,OpProgress *Prog) :
 	 _error->Error(_("Cache has an incompatible versioning system"));
 	 return;
       }
+
+      // Strings written later must still be found in the unique list
+      for (pkgCache::StringItem *I = Cache.StringItemP + Cache.HeaderP->StringList;
+	   I != Cache.StringItemP; I = Cache.StringItemP + I->NextItem)
+      {
+	 std::string_view const Str(Cache.StrP + I->String);
+	 Strings.emplace(Str,I->String);
+	 UniqStrings.emplace(Str,I->String);
+      }
    }
 
    Cache.HeaderP->Dirty = true;
@@ -107,6 +124,8 @@ pkgCacheGenerator::~pkgCacheGenerator()
 {
    if (_error->PendingError() == true)
       return;
+
+   Cache.HeaderP->MapGrowths = Map.Growths();
    if (Map.Sync() == false)
       return;
 
@@ -119,14 +138,31 @@ pkgCacheGenerator::~pkgCacheGenerator()
 }
 									/*}}}*/
 // CacheGenerator::WriteStringInMap					/*{{{*/
+// ---------------------------------------------------------------------
+/* Each string is written only once and then shared. The keys of the
+   table point to the copies in the map, which never moves. */
 std::optional<unsigned long> pkgCacheGenerator::WriteStringInMap(const char *String,
 					unsigned long Len) {
-   return Map.WriteString(String, Len);
+   auto const I = Strings.find(std::string_view(String,Len));
+   if (I != Strings.end())
+   {
+      Cache.HeaderP->InternHits++;
+      return I->second;
+   }
+
+   const auto Result = Map.WriteString(String, Len);
+   if (!Result)
+      return std::nullopt;
+
+   Cache.HeaderP->InternMisses++;
+   Strings.emplace(std::string_view(static_cast<const char *>(Map.Data()) + *Result,Len),
+		   *Result);
+   return Result;
 }
 									/*}}}*/
 // CacheGenerator::WriteStringInMap					/*{{{*/
 std::optional<unsigned long> pkgCacheGenerator::WriteStringInMap(const char *String) {
-   return Map.WriteString(String);
+   return WriteStringInMap(String, strlen(String));
 }
 									/*}}}*/
 std::optional<unsigned long> pkgCacheGenerator::AllocateInMap(unsigned long size) {/*{{{*/
@@ -298,6 +334,10 @@ bool pkgCacheGenerator::MergeFileProvides(ListParser &List)
 {
    List.Owner = this;
 
+   // Nothing could be provided
+   if (GetFileDeps().empty() == true)
+      return true;
+
    unsigned int Counter = 0;
    while (List.Step() == true)
    {
@@ -374,6 +414,64 @@ bool pkgCacheGenerator::MergeFileProvides(ListParser &List)
    return true;
 }
 									/*}}}*/
+// CacheGenerator::ResizeHashTable - Move packages to a new table	/*{{{*/
+// ---------------------------------------------------------------------
+/* Size must be a power of two. The old table is simply left behind in the
+   map, and being at most half the size of the new one the slack never
+   gets bigger than the table itself. */
+bool pkgCacheGenerator::ResizeHashTable(unsigned long Size)
+{
+   const auto idxTable = Map.RawAllocate(Size*sizeof(map_ptrloc),sizeof(map_ptrloc));
+   if (!idxTable)
+      return false;
+   map_ptrloc *Table = (map_ptrloc *)(Cache.StrP + *idxTable);
+   memset(Table,0,Size*sizeof(map_ptrloc));
+
+   map_ptrloc *OldTable = Cache.HashTableP;
+   unsigned long OldSize = Cache.HeaderP->HashTableSize;
+   Cache.HeaderP->HashTable = *idxTable;
+   Cache.HeaderP->HashTableSize = Size;
+   Cache.HashTableP = Table;
+
+   // Relink every chain of the old table into the new one
+   for (unsigned long I = 0; I != OldSize; I++)
+   {
+      for (map_ptrloc P = OldTable[I]; P != 0;)
+      {
+	 pkgCache::Package *Pkg = Cache.PkgP + P;
+	 unsigned long Hash = Cache.Hash(Cache.StrP + Pkg->Name);
+	 P = Pkg->NextPackage;
+	 Pkg->NextPackage = Table[Hash];
+	 Table[Hash] = Pkg - Cache.PkgP;
+      }
+   }
+   return true;
+}
+									/*}}}*/
+// CacheGenerator::GetFileDeps - Index the file packages		/*{{{*/
+// ---------------------------------------------------------------------
+/* List parsers match the files of each package against this, so that the
+   file provides pass does not look every file of the distribution up in
+   the cache. Packages are never removed, so the index is only rebuilt if
+   some were added since. */
+const pkgCacheGenerator::FileDepIndex &pkgCacheGenerator::GetFileDeps()
+{
+   if (FileDepsCount == Cache.HeaderP->PackageCount)
+      return FileDeps;
+
+   FileDeps.clear();
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; Pkg++)
+   {
+      const char *Name = Pkg.Name();
+      if (Name[0] != '/')
+	 continue;
+      const char *Base = strrchr(Name,'/') + 1;
+      FileDeps[std::string_view(Name,Base - Name)][Base] = Name;
+   }
+   FileDepsCount = Cache.HeaderP->PackageCount;
+   return FileDeps;
+}
+									/*}}}*/
 // CacheGenerator::NewPackage - Add a new package			/*{{{*/
 // ---------------------------------------------------------------------
 /* This creates a new package structure and adds it to the hash table */
@@ -400,15 +498,24 @@ bool pkgCacheGenerator::NewPackage(pkgCache::PkgIterator &Pkg, const string &Nam
 
    Pkg = pkgCache::PkgIterator(Cache,Cache.PkgP + *Package);
 
+   // Keep the chains short, about one package per bucket
+   if (Cache.HeaderP->PackageCount >= Cache.HeaderP->HashTableSize &&
+       ResizeHashTable(Cache.HeaderP->HashTableSize*2) == false)
+      return false;
+
    // Insert it into the hash table
    unsigned long Hash = Cache.Hash(Name);
-   Pkg->NextPackage = Cache.HeaderP->HashTable[Hash];
-   Cache.HeaderP->HashTable[Hash] = *Package;
+   Pkg->NextPackage = Cache.HashTableP[Hash];
+   Cache.HashTableP[Hash] = *Package;
 
    // Set the name and the ID
    Pkg->Name = *idxName;
    Pkg->ID = Cache.HeaderP->PackageCount++;
 
+   // Older versions have no provides for it yet
+   if (Name[0] == '/')
+      FoundNewFileDeps = true;
+
    return true;
 }
 									/*}}}*/
@@ -491,6 +598,30 @@ std::optional<unsigned long> pkgCacheGenerator::NewVersion(pkgCache::VerIterator
    return Version;
 }
 									/*}}}*/
+// CacheGenerator::DependsTail - Link where a new dependency goes	/*{{{*/
+// ---------------------------------------------------------------------
+/* Versions get their dependencies appended one at a time, and a version
+   with hundreds of them made walking the list to its end quadratic. Only
+   versions which were already in the map before this generator saw them
+   are ever walked, and just once. */
+map_ptrloc *pkgCacheGenerator::DependsTail(pkgCache::VerIterator &Ver)
+{
+   if (Ver->ID >= DepTails.size())
+      DepTails.resize(Cache.HeaderP->VersionCount,NoDepTail);
+
+   map_ptrloc &Tail = DepTails[Ver->ID];
+   if (Tail == NoDepTail)
+   {
+      Tail = 0;
+      for (pkgCache::DepIterator D = Ver.DependsList(); D.end() == false; D++)
+	 Tail = D.Index();
+   }
+
+   if (Tail == 0)
+      return &Ver->DependsList;
+   return &Cache.DepP[Tail].NextDepends;
+}
+									/*}}}*/
 // ListParser::NewDepends - Create a dependency element			/*{{{*/
 // ---------------------------------------------------------------------
 /* This creates a dependency element in the tree. It is linked to the
@@ -541,23 +672,15 @@ bool pkgCacheGenerator::ListParser::NewDepends(pkgCache::VerIterator &Ver,
    Dep->NextRevDepends = Pkg->RevDepends;
    Pkg->RevDepends = Dep.Index();
 
-   /* Link it to the version (at the end of the list)
-      Caching the old end point speeds up generation substantially */
-   if (OldDepVer != Ver)
-   {
-      OldDepLast = &Ver->DependsList;
-      for (pkgCache::DepIterator D = Ver.DependsList(); D.end() == false; D++)
-	 OldDepLast = &D->NextDepends;
-      OldDepVer = Ver;
-   }
-
    // Is it a file dependency?
    if (PackageName[0] == '/')
       FoundFileDeps = true;
 
-   Dep->NextDepends = *OldDepLast;
-   *OldDepLast = Dep.Index();
-   OldDepLast = &Dep->NextDepends;
+   // Link it to the version (at the end of the list)
+   map_ptrloc *Last = Owner->DependsTail(Ver);
+   Dep->NextDepends = *Last;
+   *Last = Dep.Index();
+   Owner->DepTails[Ver->ID] = Dep.Index();
 
    return true;
 }
@@ -623,6 +746,83 @@ bool pkgCacheGenerator::ListParser::NewProvides(pkgCache::VerIterator &Ver,
    Prv->NextProvides = Pkg->ProvidesList;
    Pkg->ProvidesList = Prv.Index();
 
+   return true;
+}
+									/*}}}*/
+// CacheGenerator::DropFiles - Remove package files from the cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* Dropped is indexed by package file ID. The files are unlinked together
+   with their Ver/File relations, and the package state that came from a
+   dropped status file is reset. Every version must keep a file of its
+   own, see DropsVersions, so that no package, version or dependency goes
+   away and merging the files again gives what a full rebuild would.
+   Nothing is freed, the unreachable space is recorded in DroppedSize. */
+bool pkgCacheGenerator::DropFiles(const std::vector<bool> &Dropped)
+{
+   pkgCache::Header &Head = *Cache.HeaderP;
+   unsigned long Size = 0;
+
+   // The files merged again take the IDs after the highest one kept
+   unsigned long FileCount = 0;
+   for (map_ptrloc *Last = &Head.FileList; *Last != 0;)
+   {
+      pkgCache::PackageFile *File = Cache.PkgFileP + *Last;
+      if (Dropped[File->ID] == true)
+      {
+	 *Last = File->NextFile;
+	 Size += sizeof(*File);
+      }
+      else
+      {
+	 FileCount = std::max(FileCount,(unsigned long)File->ID + 1);
+	 Last = &File->NextFile;
+      }
+   }
+
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; Pkg++)
+   {
+      bool Touched = false;
+      for (pkgCache::VerIterator Ver = Pkg.VersionList(); Ver.end() == false; Ver++)
+      {
+	 bool LostStatus = false;
+	 for (map_ptrloc *Last = &Ver->FileList; *Last != 0;)
+	 {
+	    pkgCache::VerFile *VF = Cache.VerFileP + *Last;
+	    pkgCache::PackageFile *File = Cache.PkgFileP + VF->File;
+	    if (Dropped[File->ID] == false)
+	    {
+	       Last = &VF->NextFile;
+	       continue;
+	    }
+	    *Last = VF->NextFile;
+	    Head.VerFileCount--;
+	    Size += sizeof(*VF);
+	    Touched = true;
+	    if ((File->Flags & pkgCache::Flag::NotSource) != 0)
+	       LostStatus = true;
+	 }
+	 if (Ver->FileList == 0)
+	    return _error->Error("Dropping the package files leaves %s without a file",
+				 Pkg.Name());
+
+	 // Only the status file sets the current version
+	 if (LostStatus == true && Pkg.CurrentVer() == Ver)
+	 {
+	    Pkg->CurrentVer = 0;
+	    Pkg->SelectedState = 0;
+	    Pkg->InstState = 0;
+	    Pkg->CurrentState = 0;
+	 }
+      }
+
+      // The flags come from the last record merged, and only the status
+      // file can make a package automatically installed.
+      if (Touched == true)
+	 Pkg->Flags &= ~pkgCache::Flag::Auto;
+   }
+
+   Head.PackageFileCount = FileCount;
+   Head.DroppedSize += Size;
    return true;
 }
 									/*}}}*/
@@ -662,34 +862,16 @@ bool pkgCacheGenerator::SelectFile(const string &File, const string &Site,
 // CacheGenerator::WriteUniqueString - Insert a unique string		/*{{{*/
 // ---------------------------------------------------------------------
 /* This is used to create handles to strings. Given the same text it
-   always returns the same number */
+   always returns the same number. Such strings are also kept in the
+   StringList of the cache. */
 std::optional<unsigned long> pkgCacheGenerator::WriteUniqString(const char *S,
 						 unsigned int Size)
 {
-   /* We use a very small transient hash table here, this speeds up generation
-      by a fair amount on slower machines */
-   pkgCache::StringItem *&Bucket = UniqHash[(S[0]*5 + S[1]) % _count(UniqHash)];
-   if (Bucket != 0 &&
-       stringcmp(S,S+Size,Cache.StrP + Bucket->String) == 0)
-      return Bucket->String;
-
-   // Search for an insertion point
-   pkgCache::StringItem *I = Cache.StringItemP + Cache.HeaderP->StringList;
-   int Res = 1;
-   map_ptrloc *Last = &Cache.HeaderP->StringList;
-   for (; I != Cache.StringItemP; Last = &I->NextItem,
-        I = Cache.StringItemP + I->NextItem)
-   {
-      Res = stringcmp(S,S+Size,Cache.StrP + I->String);
-      if (Res >= 0)
-	 break;
-   }
-
-   // Match
-   if (Res == 0)
+   auto const I = UniqStrings.find(std::string_view(S,Size));
+   if (I != UniqStrings.end())
    {
-      Bucket = I;
-      return I->String;
+      Cache.HeaderP->InternHits++;
+      return I->second;
    }
 
    // Get a structure
@@ -700,11 +882,11 @@ std::optional<unsigned long> pkgCacheGenerator::WriteUniqString(const char *S,
 
    // Fill in the structure
    pkgCache::StringItem *ItemP = Cache.StringItemP + *Item;
-   ItemP->NextItem = I - Cache.StringItemP;
-   *Last = *Item;
+   ItemP->NextItem = Cache.HeaderP->StringList;
+   Cache.HeaderP->StringList = *Item;
    ItemP->String = *idxString;
 
-   Bucket = ItemP;
+   UniqStrings.emplace(std::string_view(Cache.StrP + *idxString,Size),*idxString);
    return ItemP->String;
 }
 									/*}}}*/
@@ -775,8 +957,10 @@ static std::unique_ptr<MMap> CheckValidity(const string &CacheFile, FileIterator
       Visited[File->ID] = true;
    }
 
-   for (unsigned I = 0; I != Cache.HeaderP->PackageFileCount; I++)
-      if (Visited[I] == false)
+   // IDs of dropped files are not reused, so walk the list itself
+   for (pkgCache::PkgFileIterator File = Cache.FileBegin();
+	File.end() == false; File++)
+      if (Visited[File->ID] == false)
       {
 	 return nullptr;
       }
@@ -806,35 +990,130 @@ static unsigned long ComputeSize(FileIterator Start,FileIterator End)
    return TotalSize;
 }
 									/*}}}*/
+// IndexPreparser - Decode index files on worker threads		/*{{{*/
+// ---------------------------------------------------------------------
+/* The workers call pkgIndexFile::Preparse() on the index files in list
+   order, running at most a few files ahead of the generator, which still
+   merges them one at a time and in the same order. Since the generator
+   gets exactly the same data, the cache is the same as a serial build. */
+class IndexPreparser
+{
+   vector<pkgIndexFile *> Files;
+   vector<bool> Ready;
+   vector<pkgIndexFile *>::size_type Next;
+   vector<pkgIndexFile *>::size_type Merged;
+   vector<pkgIndexFile *>::size_type Window;
+   bool Stop;
+
+   std::mutex Lock;
+   std::condition_variable Cond;
+   vector<std::thread> Workers;
+
+   void Work()
+   {
+      std::unique_lock<std::mutex> Guard(Lock);
+      while (true)
+      {
+	 Cond.wait(Guard,[this] {
+	    return Stop == true || Next == Files.size() ||
+		   Next < Merged + Window;});
+	 if (Stop == true || Next == Files.size())
+	    return;
+
+	 const auto Item = Next++;
+	 Guard.unlock();
+	 Files[Item]->Preparse();
+	 _error->Discard();
+	 Guard.lock();
+
+	 Ready[Item] = true;
+	 Cond.notify_all();
+      }
+   }
+
+   public:
+
+   // Blocks until the index file at Pos (in list order) is preparsed
+   void Wait(vector<pkgIndexFile *>::size_type Pos)
+   {
+      std::unique_lock<std::mutex> Guard(Lock);
+      Cond.wait(Guard,[this,Pos] {return Ready[Pos] == true;});
+   }
+
+   // Marks everything up to Pos as merged, letting the workers go on
+   void Done(vector<pkgIndexFile *>::size_type Pos)
+   {
+      std::lock_guard<std::mutex> Guard(Lock);
+      Merged = Pos + 1;
+      Cond.notify_all();
+   }
+
+   IndexPreparser(const vector<pkgIndexFile *> &Files,unsigned int Threads) :
+      Files(Files), Ready(Files.size(),false), Next(0), Merged(0),
+      Window(2*Threads), Stop(false)
+   {
+      for (unsigned int I = 0; I != Threads; I++)
+	 Workers.push_back(std::thread(&IndexPreparser::Work,this));
+   }
+   ~IndexPreparser()
+   {
+      {
+	 std::lock_guard<std::mutex> Guard(Lock);
+	 Stop = true;
+      }
+      Cond.notify_all();
+      for (vector<std::thread>::iterator I = Workers.begin();
+	   I != Workers.end(); I++)
+	 I->join();
+
+      // Whatever was not merged must not be picked up by a later build
+      for (vector<pkgIndexFile *>::iterator I = Files.begin();
+	   I != Files.end(); I++)
+	 (*I)->DropPreparsed();
+   }
+};
+									/*}}}*/
 // BuildCache - Merge the list of index files into the cache		/*{{{*/
 // ---------------------------------------------------------------------
-/* */
+/* With APT::Cache-Threads above 1 the index files are decoded on that
+   many worker threads while the merging stays here. */
 static bool BuildCache(pkgCacheGenerator &Gen,
 		       OpProgress &Progress,
 		       unsigned long &CurrentSize,unsigned long TotalSize,
 		       FileIterator Start, FileIterator End)
 {
-   FileIterator I;
-   for (I = Start; I != End; I++)
+   vector<pkgIndexFile *> Candidates;
+   for (FileIterator I = Start; I != End; I++)
+      if ((*I)->HasPackages() == true && (*I)->Exists() == true)
+	 Candidates.push_back(*I);
+
+   const int Threads = _config->FindI("APT::Cache-Threads",1);
+   std::unique_ptr<IndexPreparser> Preparser;
+   if (Threads > 1 && Candidates.size() > 1)
+      Preparser.reset(new IndexPreparser(Candidates,Threads));
+
+   for (vector<pkgIndexFile *>::size_type Pos = 0; Pos != Candidates.size(); Pos++)
    {
-      if ((*I)->HasPackages() == false)
-	 continue;
+      pkgIndexFile * const I = Candidates[Pos];
 
-      if ((*I)->Exists() == false)
-	 continue;
+      if (Preparser != nullptr)
+      {
+	 Preparser->Wait(Pos);
+	 Preparser->Done(Pos);
+      }
 
-      if ((*I)->FindInCache(Gen.GetCache()).end() == false)
+      if (I->FindInCache(Gen.GetCache()).end() == false)
       {
 	 _error->Warning("Duplicate sources.list entry %s",
-			 (*I)->Describe().c_str());
+			 I->Describe().c_str());
 	 continue;
       }
 
-      unsigned long Size = (*I)->Size();
+      unsigned long Size = I->Size();
       Progress.OverallProgress(CurrentSize,TotalSize,Size,_("Reading Package Lists"));
       CurrentSize += Size;
 
-      if ((*I)->Merge(Gen,Progress) == false)
+      if (I->Merge(Gen,Progress) == false)
 	 return false;
    }
 
@@ -867,6 +1146,153 @@ static bool CollectFileProvides(pkgCacheGenerator &Gen,
    return true;
 }
 									/*}}}*/
+// DropsVersions - Check if dropping files would remove a version	/*{{{*/
+// ---------------------------------------------------------------------
+/* A version only found in the dropped files goes away with them, and so
+   may its package and the packages its dependencies created. Leaving
+   them in the hash table, or their IDs in the counts, would not give
+   what a full rebuild does, so the cache is then built again. */
+static bool DropsVersions(pkgCache &Cache,const std::vector<bool> &Dropped)
+{
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; Pkg++)
+      for (pkgCache::VerIterator Ver = Pkg.VersionList(); Ver.end() == false; Ver++)
+      {
+	 pkgCache::VerFileIterator VF = Ver.FileList();
+	 for (; VF.end() == false; VF++)
+	    if (Dropped[VF.File()->ID] == false)
+	       break;
+	 if (VF.end() == true)
+	    return true;
+      }
+   return false;
+}
+									/*}}}*/
+// UpdateCache - Merge again only the files changed since the last build	/*{{{*/
+// ---------------------------------------------------------------------
+/* The index files are merged in list order, so this is also the order of
+   the package file IDs in the old cache. The files matching an unchanged
+   head of the list are kept and the rest is dropped and merged again;
+   when only the database changed that is all there is to do. Merging in
+   the same order keeps the result the same as a full rebuild, but for the
+   unreachable space left in the map, as long as every version is still
+   found in a kept file. Returns null when the full rebuild should be done
+   instead. */
+static std::unique_ptr<MMap> UpdateCache(const string &CacheFile,bool Writeable,
+					 vector<pkgIndexFile *> &Files,
+					 OpProgress &Progress,
+					 unsigned long MapSize)
+{
+   if (_config->FindB("APT::Cache-Incremental",true) == false ||
+       _config->FindB("APT::Get::ReInstall",false) == true ||
+       CacheFile.empty() == true || FileExists(CacheFile) == false)
+      return nullptr;
+
+   FileFd OldF(CacheFile,FileFd::ReadOnly);
+   SPtr<MMap> OldMap(new MMap(OldF,MMap::Public | MMap::ReadOnly));
+   pkgCache Old(*OldMap.get());
+   if (_error->PendingError() == true || OldMap->Size() == 0)
+      return nullptr;
+
+   // Start over once half of the map would be dropped data
+   if (_system->OptionsHash() != Old.HeaderP->OptionsHash ||
+       Old.HeaderP->MovedVersions == true ||
+       Old.HeaderP->DroppedSize > OldMap->Size()/2)
+      return nullptr;
+
+   vector<pkgCache::PackageFile *> OldFiles;
+   for (pkgCache::PkgFileIterator File = Old.FileBegin(); File.end() == false; File++)
+      OldFiles.push_back(File);
+   std::sort(OldFiles.begin(),OldFiles.end(),
+	     [](const pkgCache::PackageFile *A,const pkgCache::PackageFile *B)
+	     {return A->ID < B->ID;});
+
+   vector<pkgIndexFile *>::iterator Start = Files.begin();
+   vector<pkgCache::PackageFile *>::size_type Kept = 0;
+   for (; Start != Files.end() && Kept != OldFiles.size(); Start++)
+   {
+      if ((*Start)->HasPackages() == false || (*Start)->Exists() == false)
+	 continue;
+      pkgCache::PkgFileIterator File = (*Start)->FindInCache(Old);
+      if (File.end() == true || File != OldFiles[Kept])
+	 break;
+      Kept++;
+   }
+   if (Kept == 0)
+      return nullptr;
+
+   std::vector<bool> Dropped(Old.HeaderP->PackageFileCount,false);
+   for (vector<pkgCache::PackageFile *>::size_type I = Kept; I != OldFiles.size(); I++)
+      Dropped[OldFiles[I]->ID] = true;
+   if (DropsVersions(Old,Dropped) == true)
+      return nullptr;
+
+   SPtr<FileFd> CacheF;
+   SPtr<DynamicMMap> Map;
+   if (Writeable == true)
+   {
+      unlink(CacheFile.c_str());
+      CacheF.reset(new FileFd(CacheFile,FileFd::WriteEmpty));
+      if (_error->PendingError() == true)
+	 return nullptr;
+      fchmod(CacheF->Fd(),0644);
+      Map.reset(new DynamicMMap(*CacheF,MMap::Public,MapSize));
+   }
+   else
+      Map.reset(new DynamicMMap(MMap::Public,MapSize));
+
+   // Preload the map with the old cache
+   {
+      const auto idxAllocate = Map->RawAllocate(OldMap->Size());
+      if (!idxAllocate)
+	 return nullptr;
+      memcpy(static_cast<char *>(Map->Data()) + *idxAllocate,
+	     OldMap->Data(),OldMap->Size());
+   }
+   OldMap.reset();
+
+   unsigned long CurrentSize = 0;
+   unsigned long HeadSize = ComputeSize(Files.begin(),Start);
+   unsigned long TotalSize = ComputeSize(Start,Files.end());
+   TotalSize = (TotalSize*2)+HeadSize;
+
+   {
+      pkgCacheGenerator Gen(*Map.get(),&Progress);
+      if (_error->PendingError() == true)
+	 return nullptr;
+      if (Gen.DropFiles(Dropped) == false ||
+	  BuildCache(Gen,Progress,CurrentSize,TotalSize,
+		     Start,Files.end()) == false)
+	 return nullptr;
+
+      if (Gen.HasFileDeps() == true)
+	 Gen.GetCache().HeaderP->HasFileDeps = true;
+      if (Gen.HasNewFileDeps() == true) {
+	 // There are new file dependencies. Collect over all packages.
+	 if (CollectFileProvides(Gen,Progress,CurrentSize,TotalSize,
+				 Files.begin(),Files.end()) == false)
+	    return nullptr;
+      } else if (Gen.GetCache().HeaderP->HasFileDeps == true) {
+	 // Jump entries which are not going to be parsed.
+	 CurrentSize += HeadSize;
+	 // No new file dependencies. Collect over the new packages.
+	 if (CollectFileProvides(Gen,Progress,CurrentSize,TotalSize,
+				 Start,Files.end()) == false)
+	    return nullptr;
+      }
+   }
+
+   if (_error->PendingError() == true)
+      return nullptr;
+
+   if (CacheF != nullptr)
+   {
+      Map.reset();
+      return std::unique_ptr<MMap>(new MMap(*CacheF,MMap::Public | MMap::ReadOnly));
+   }
+
+   return Map;
+}
+									/*}}}*/
 // MakeStatusCache - Construct the status cache				/*{{{*/
 // ---------------------------------------------------------------------
 /* This makes sure that the status cache (the cache that has all
@@ -879,7 +1305,7 @@ static bool CollectFileProvides(pkgCacheGenerator &Gen,
 std::unique_ptr<MMap> pkgMakeStatusCache(pkgSourceList &List,OpProgress &Progress,
                                          bool AllowMem)
 {
-   const unsigned long MapSize = getConfiguredCacheLimit(__func__);
+   const unsigned long MapSize = getConfiguredCacheLimit();
 
    vector<pkgIndexFile *> Files(List.begin(),List.end());
    unsigned long EndOfSource = Files.size();
@@ -915,6 +1341,21 @@ std::unique_ptr<MMap> pkgMakeStatusCache(pkgSourceList &List,OpProgress &Progres
       }
    }
 
+   // Errors here only mean that the full rebuild below is needed.
+   _error->PushState();
+   {
+      std::unique_ptr<MMap> Map = UpdateCache(CacheFile,Writeable,Files,
+					      Progress,MapSize);
+      if (Map)
+      {
+	 _error->PopState();
+	 Progress.OverallProgress(1,1,1,_("Reading Package Lists"));
+	 return Map;
+      }
+   }
+   _error->Discard();
+   _error->PopState();
+
    // CNC:2002-07-03
 #if DYING
    if (_system->PreProcess(Files.begin(),Files.end(),Progress) == false)
@@ -1098,7 +1539,7 @@ std::unique_ptr<MMap> pkgMakeStatusCache(pkgSourceList &List,OpProgress &Progres
 /* */
 std::unique_ptr<DynamicMMap> pkgMakeOnlyStatusCache(OpProgress &Progress)
 {
-   const unsigned long MapSize = getConfiguredCacheLimit(__func__);
+   const unsigned long MapSize = getConfiguredCacheLimit();
    vector<pkgIndexFile *> Files;
    unsigned long EndOfSource = Files.size();
    if (_system->AddStatusFiles(Files) == false)
@@ -20,6 +20,9 @@
 
 #include <apt-pkg/pkgcache.h>
 #include <memory>
+#include <vector>
+#include <string_view>
+#include <unordered_map>
 
 #include <optional>
 
@@ -32,7 +35,9 @@ class pkgCacheGenerator
 {
    private:
 
-   pkgCache::StringItem *UniqHash[26];
+   // Strings already written to the map, by their text
+   std::unordered_map<std::string_view,map_ptrloc> Strings;
+   std::unordered_map<std::string_view,map_ptrloc> UniqStrings;
    std::optional<unsigned long> WriteStringInMap(const std::string &String) { return WriteStringInMap(String.c_str(), String.length()); }
    std::optional<unsigned long> WriteStringInMap(const char *String);
    std::optional<unsigned long> WriteStringInMap(const char *String, unsigned long Len);
@@ -43,6 +48,11 @@ class pkgCacheGenerator
    class ListParser;
    friend class ListParser;
 
+   /* Package names which are paths, by dirname (with the trailing slash)
+      and then basename, each giving the whole name in the map */
+   typedef std::unordered_map<std::string_view,const char *> FileDepBases;
+   typedef std::unordered_map<std::string_view,FileDepBases> FileDepIndex;
+
    protected:
 
    DynamicMMap &Map;
@@ -54,7 +64,19 @@ class pkgCacheGenerator
 
    // Flag file dependencies
    bool FoundFileDeps;
+   bool FoundNewFileDeps;
+
+   /* The last dependency of each version by its ID, so that appending to
+      the DependsList never walks it. NoDepTail if not known yet. */
+   static constexpr map_ptrloc NoDepTail = ~(map_ptrloc)0;
+   std::vector<map_ptrloc> DepTails;
+   map_ptrloc *DependsTail(pkgCache::VerIterator &Ver);
+
+   // Built for the PackageCount in FileDepsCount
+   FileDepIndex FileDeps;
+   unsigned long FileDepsCount;
 
+   bool ResizeHashTable(unsigned long Size);
    bool NewFileVer(pkgCache::VerIterator &Ver,ListParser &List);
    std::optional<unsigned long> NewVersion(pkgCache::VerIterator &Ver,const string &VerStr,unsigned long Next);
 
@@ -75,7 +97,12 @@ class pkgCacheGenerator
          {return pkgCache::PkgFileIterator(Cache,CurrentFile);}
 
    bool HasFileDeps() {return FoundFileDeps;}
+   bool HasNewFileDeps() {return FoundNewFileDeps;}
    bool MergeFileProvides(ListParser &List);
+   const FileDepIndex &GetFileDeps();
+
+   // Unlinks the package files whose IDs are set, to merge them again
+   bool DropFiles(const std::vector<bool> &Dropped);
 
    // CNC:2003-03-18
    inline void ResetFileDeps() {FoundFileDeps = false;}
@@ -87,10 +114,6 @@ class pkgCacheGenerator
 // This is the abstract package list parser class.
 class pkgCacheGenerator::ListParser
 {
-   // Some cache items
-   pkgCache::VerIterator OldDepVer;
-   map_ptrloc *OldDepLast;
-
    // Flag file dependencies
    bool FoundFileDeps;
 
@@ -21,13 +21,13 @@
 
 // Records::pkgRecords - Constructor					/*{{{*/
 // ---------------------------------------------------------------------
-/* This will create the necessary structures to access the status files */
+/* This will create the necessary structures to access the status files.
+   The parsers themselves are only created by the first Lookup() into
+   their file, so that looking at a few packages doesn't open every
+   index file, but the types are checked right away. */
 pkgRecords::pkgRecords(pkgCache &Cache) : Cache(Cache),
-  Files(Cache.HeaderP->PackageFileCount)
+  Files(Cache.HeaderP->PackageFileCount,0)
 {
-   // allocate and zero memory
-   //Files = new Parser *[Cache.HeaderP->PackageFileCount]();
-
    for (pkgCache::PkgFileIterator I = Cache.FileBegin();
 	I.end() == false; I++)
    {
@@ -37,10 +37,6 @@ pkgRecords::pkgRecords(pkgCache &Cache) : Cache(Cache),
 	 _error->Error(_("Index file type '%s' is not supported"),I.IndexType());
 	 return;
       }
-
-      Files[I->ID] = Type->CreatePkgParser(I);
-      if (Files[I->ID] == 0)
-	 return;
    }
 }
 									/*}}}*/
@@ -62,7 +58,13 @@ pkgRecords::~pkgRecords()
 /* */
 pkgRecords::Parser &pkgRecords::Lookup(pkgCache::VerFileIterator const &Ver)
 {
-   Files[Ver.File()->ID]->Jump(Ver);
-   return *Files[Ver.File()->ID];
+   Parser *&P = Files[Ver.File()->ID];
+   if (P == 0)
+   {
+      pkgCache::PkgFileIterator File = Ver.File();
+      P = pkgIndexFile::Type::GetType(File.IndexType())->CreatePkgParser(File);
+   }
+   P->Jump(Ver);
+   return *P;
 }
 									/*}}}*/
@@ -65,6 +65,14 @@ class pkgRecords::Parser
 
    // The record in binary form
    virtual void GetRec(const char *&Start,const char *&Stop) = 0;
+   // The same, appended to Out
+   virtual void AppendRec(string &Out)
+   {
+      const char *Start;
+      const char *Stop;
+      GetRec(Start,Stop);
+      Out.append(Start,Stop - Start);
+   }
 
    // CNC:2003-11-21
    virtual bool HasFile(const char *File) = 0;
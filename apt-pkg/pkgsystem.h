@@ -43,6 +43,7 @@ class pkgPackageManager;
 class pkgVersioningSystem;
 class Configuration;
 class pkgIndexFile;
+class pkgSourceList;
 
 // CNC:2002-07-05
 class pkgProblemResolver;
@@ -110,6 +111,9 @@ class pkgSystem
    // CNC:2003-11-24
    virtual unsigned long OptionsHash() const {return 0;}
 
+   // Remove what is kept for index files which are no longer in List
+   virtual bool PruneCaches(pkgSourceList const &/*List*/) {return true;}
+
    pkgSystem();
    virtual ~pkgSystem() {}
 };
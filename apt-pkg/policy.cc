@@ -36,7 +36,9 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <thread>
 									/*}}}*/
 
 using namespace std;
@@ -45,7 +47,8 @@ using namespace std;
 // ---------------------------------------------------------------------
 /* Set the defaults for operation. The default mode with no loaded policy
    file matches the V0 policy engine. */
-pkgPolicy::pkgPolicy(pkgCache *Owner) : Pins(0), PFPriority(0), Cache(Owner)
+pkgPolicy::pkgPolicy(pkgCache *Owner) : Pins(0), PFPriority(0), Cache(Owner),
+					 Memoized(false)
 {
    PFPriority = new signed short[Owner->Head().PackageFileCount];
    Pins = new Pin[Owner->Head().PackageCount];
@@ -66,6 +69,8 @@ pkgPolicy::pkgPolicy(pkgCache *Owner) : Pins(0), PFPriority(0), Cache(Owner)
 /* */
 bool pkgPolicy::InitDefaults()
 {
+   Memoized = false;
+
    // Initialize the priorities based on the status of the package file
    for (pkgCache::PkgFileIterator I = Cache->FileBegin(); I != Cache->FileEnd(); I++)
    {
@@ -113,15 +118,93 @@ bool pkgPolicy::InitDefaults()
    return true;
 }
 									/*}}}*/
+// Policy::Memoize - Work out the pins of every package		/*{{{*/
+// ---------------------------------------------------------------------
+/* The match, candidate and priority of a package only depend on the pins
+   and on the package itself, so with APT::DepCache-Threads above 1 the
+   packages are shared out in small runs between that many threads. */
+void pkgPolicy::Memoize()
+{
+   const unsigned long Count = Cache->Head().PackageCount;
+   MatchVers.assign(Count,0);
+   CandVers.assign(Count,0);
+   PkgPrios.assign(Count,0);
+
+   unsigned long Threads = _config->FindI("APT::DepCache-Threads",1);
+   unsigned long Share = _config->FindI("APT::DepCache-Threads::Min-Packages",1000);
+   if (Share == 0)
+      Share = 1;
+   if (Threads > Count/Share)
+      Threads = Count/Share;
+   if (Threads <= 1)
+   {
+      for (pkgCache::PkgIterator I = Cache->PkgBegin(); I.end() == false; I++)
+	 MemoizePkg(I);
+      Memoized = true;
+      return;
+   }
+
+   std::vector<pkgCache::Package *> Pkgs;
+   Pkgs.reserve(Count);
+   for (pkgCache::PkgIterator I = Cache->PkgBegin(); I.end() == false; I++)
+      Pkgs.push_back(I);
+
+   static const std::vector<pkgCache::Package *>::size_type Run = 256;
+   std::atomic<std::vector<pkgCache::Package *>::size_type> Next(0);
+   auto Work = [this,&Pkgs,&Next]() {
+      while (true)
+      {
+	 std::vector<pkgCache::Package *>::size_type Start = Next.fetch_add(Run);
+	 if (Start >= Pkgs.size())
+	    return;
+	 std::vector<pkgCache::Package *>::size_type End = std::min(Start + Run,Pkgs.size());
+	 for (std::vector<pkgCache::Package *>::size_type I = Start; I != End; I++)
+	    MemoizePkg(pkgCache::PkgIterator(*Cache,Pkgs[I]));
+      }
+   };
+
+   std::vector<std::thread> Workers;
+   for (unsigned long I = 1; I != Threads; I++)
+      Workers.push_back(std::thread(Work));
+   Work();
+   for (std::vector<std::thread>::iterator I = Workers.begin();
+	I != Workers.end(); I++)
+      I->join();
+   Memoized = true;
+}
+									/*}}}*/
+// Policy::MemoizePkg - Work out the pins of a single package		/*{{{*/
+// ---------------------------------------------------------------------
+/* The match goes first as the candidate depends on it. Nothing but the
+   tables is written, so they come out the same however often they are
+   worked out again. */
+void pkgPolicy::MemoizePkg(pkgCache::PkgIterator Pkg)
+{
+   // CNC:2004-05-29
+   pkgCache::VerIterator Match = FindMatch(Pkg);
+   MatchVers[Pkg->ID] = Match;
+   CandVers[Pkg->ID] = FindCandidateVer(Pkg,Match);
+   PkgPrios[Pkg->ID] = FindPkgPriority(Pkg);
+}
+									/*}}}*/
 // Policy::GetCandidateVer - Get the candidate install version		/*{{{*/
 // ---------------------------------------------------------------------
-/* Evaluate the package pins and the default list to deteremine what the
-   best package is. */
+/* */
 pkgCache::VerIterator pkgPolicy::GetCandidateVer(pkgCache::PkgIterator Pkg)
 {
-   // Look for a package pin and evaluate it.
-   // CNC:2004-05-29
-   pkgCache::VerIterator Pref = GetMatch(Pkg);
+   if (Memoized == false)
+      Memoize();
+   return pkgCache::VerIterator(*Cache,CandVers[Pkg->ID]);
+}
+									/*}}}*/
+// Policy::FindCandidateVer - Work out the candidate install version	/*{{{*/
+// ---------------------------------------------------------------------
+/* Evaluate the package pins and the default list to deteremine what the
+   best package is, starting from Pref, the version matching the package
+   pin. */
+pkgCache::VerIterator pkgPolicy::FindCandidateVer(pkgCache::PkgIterator Pkg,
+						  pkgCache::VerIterator Pref)
+{
    signed Max = GetPriority(Pkg);
 
    /* Falling through to the default version.. Setting Max to zero
@@ -211,33 +294,45 @@ void pkgPolicy::CreatePin(pkgVersionMatch::MatchType Type, const string &Name,
    P->Type = Type;
    P->Priority = Priority;
    P->Data = Data;
+
+   // CNC:2004-05-29 - Make negative pins on individual packages
+   // behave like package<>version.
+   P->NotEquals = false;
+   if (Name.empty() == false && Type == pkgVersionMatch::Version &&
+       Priority < 0)
+   {
+      P->NotEquals = true;
+      P->Priority = 0;
+   }
+   Memoized = false;
 }
 									/*}}}*/
 // Policy::GetMatch - Get the matching version for a package pin	/*{{{*/
 // ---------------------------------------------------------------------
 /* */
 pkgCache::VerIterator pkgPolicy::GetMatch(pkgCache::PkgIterator Pkg)
+{
+   if (Memoized == false)
+      Memoize();
+   return pkgCache::VerIterator(*Cache,MatchVers[Pkg->ID]);
+}
+									/*}}}*/
+// Policy::FindMatch - Work out the matching version for a package pin	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+pkgCache::VerIterator pkgPolicy::FindMatch(pkgCache::PkgIterator Pkg)
 {
    const Pin &PPkg = Pins[Pkg->ID];
-   if (PPkg.Type != pkgVersionMatch::None)
-   {
-      // CNC:2004-05-29 - Make negative pins on individual packages
-      // behave like package<>version.
-      pkgCache::VerIterator Ver;
-      pkgVersionMatch *Match;
-      if (PPkg.Type == pkgVersionMatch::Version && PPkg.Priority < 0)
-      {
-         Match = new pkgVersionMatch(PPkg.Data,PPkg.Type, pkgCache::Dep::NotEquals);
-	 Pins[Pkg->ID].Priority = 0;
-      }
-      else
-         Match = new pkgVersionMatch(PPkg.Data,PPkg.Type);
-      Ver = Match->Find(Pkg);
-      delete Match;
+   if (PPkg.Type == pkgVersionMatch::None)
+      return pkgCache::VerIterator(*Cache);
 
-      return Ver;
+   if (PPkg.NotEquals == true)
+   {
+      pkgVersionMatch Match(PPkg.Data,PPkg.Type,pkgCache::Dep::NotEquals);
+      return Match.Find(Pkg);
    }
-   return pkgCache::VerIterator(*Pkg.Cache());
+   pkgVersionMatch Match(PPkg.Data,PPkg.Type);
+   return Match.Find(Pkg);
 }
 									/*}}}*/
 // Policy::GetPriority - Get the priority of the package pin		/*{{{*/
@@ -259,9 +354,19 @@ signed short pkgPolicy::GetPriority(pkgCache::PkgIterator const &Pkg)
 // CNC:2003-03-06
 // Policy::GetPkgPriority - Return a package priority			/*{{{*/
 // ---------------------------------------------------------------------
-/* Evaluate the package pins and the default list to deteremine what the
-   best package is. This is a hacked version of GetCandidateVer(). */
+/* */
 signed short pkgPolicy::GetPkgPriority(const pkgCache::PkgIterator &Pkg)
+{
+   if (Memoized == false)
+      Memoize();
+   return PkgPrios[Pkg->ID];
+}
+									/*}}}*/
+// Policy::FindPkgPriority - Work out a package priority		/*{{{*/
+// ---------------------------------------------------------------------
+/* Evaluate the package pins and the default list to deteremine what the
+   best package is. This is a hacked version of FindCandidateVer(). */
+signed short pkgPolicy::FindPkgPriority(pkgCache::PkgIterator Pkg)
 {
    // Look for a package pin and evaluate it.
    signed Max = GetPriority(Pkg);
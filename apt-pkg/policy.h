@@ -27,6 +27,10 @@
    if no matching versions are found, otherwise the default matching
    rules are used to locate a hit.
 
+   The pin match, candidate and priority of every package are worked out
+   together the first time one of them is asked for, and kept until the
+   pins change.
+
    ##################################################################### */
 									/*}}}*/
 #ifndef PKGLIB_POLICY_H
@@ -45,7 +49,8 @@ class pkgPolicy : public pkgDepCache::Policy
       pkgVersionMatch::MatchType Type;
       string Data;
       signed short Priority;
-      Pin() : Type(pkgVersionMatch::None), Priority(0) {}
+      bool NotEquals;
+      Pin() : Type(pkgVersionMatch::None), Priority(0), NotEquals(false) {}
    };
 
    struct PkgPin : Pin
@@ -62,6 +67,19 @@ class pkgPolicy : public pkgDepCache::Policy
    pkgCache *Cache;
    bool StatusOverride;
 
+   // Worked out for every package by Memoize, indexed by the package ID
+   vector<pkgCache::Version *> MatchVers;
+   vector<pkgCache::Version *> CandVers;
+   vector<signed short> PkgPrios;
+   bool Memoized;
+
+   void Memoize();
+   void MemoizePkg(pkgCache::PkgIterator Pkg);
+   pkgCache::VerIterator FindMatch(pkgCache::PkgIterator Pkg);
+   pkgCache::VerIterator FindCandidateVer(pkgCache::PkgIterator Pkg,
+					  pkgCache::VerIterator Pref);
+   signed short FindPkgPriority(pkgCache::PkgIterator Pkg);
+
    public:
 
    // Things for manipulating pins
@@ -15,15 +15,27 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
 #include <utime.h>
 #include <unistd.h>
+#include <errno.h>
 #include <assert.h>
-#include <sstream>
 #include <algorithm>
+#include <map>
+#include <tuple>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unordered_map>
 
 #include <apt-pkg/error.h>
 #include <apt-pkg/configuration.h>
-#include <apt-pkg/md5.h>
+#include <apt-pkg/hashes.h>
+#include <apt-pkg/pkgsystem.h>
+#include <apt-pkg/strutl.h>
 
 #include "rpmhandler.h"
 #include "rpmpackagedata.h"
@@ -40,24 +52,30 @@ string RPMHdrHandler::EVRDB() const
 {
    string str;
    raptInt val;
-   std::ostringstream res;
+   char buf[32];
    raptHeader h(HeaderP);
 
-   if (h.getTag(RPMTAG_EPOCH, val))
-      res << val << ":";
-
-   res << Version() << '-';
+   str.reserve(64);
+   if (h.getTag(RPMTAG_EPOCH, val)) {
+      snprintf(buf, sizeof(buf), "%u:", (unsigned)val);
+      str += buf;
+   }
 
-   if (h.getTag(RPMTAG_RELEASE, str))
-      res << str;
+   str += VersionView();
+   str += '-';
+   str += GetSTagView(RPMTAG_RELEASE);
 
-   if (h.getTag(RPMTAG_DISTTAG, str))
-      res << ":" << str;
+   if (headerIsEntry(HeaderP, RPMTAG_DISTTAG)) {
+      str += ':';
+      str += GetSTagView(RPMTAG_DISTTAG);
+   }
 
-   if (h.getTag(RPMTAG_BUILDTIME, val))
-      res << "@" << val;
+   if (h.getTag(RPMTAG_BUILDTIME, val)) {
+      snprintf(buf, sizeof(buf), "@%u", (unsigned)val);
+      str += buf;
+   }
 
-   return res.str();
+   return str;
 }
 
 unsigned int RPMHandler::DepOp(raptDepFlags rpmflags) const
@@ -97,6 +115,29 @@ bool RPMHandler::HasFile(const char *File) const
    return I != Files.end();
 }
 
+bool RPMHandler::FindFiles(const pkgCacheGenerator::FileDepIndex &Wanted,
+			   vector<const char *> &Found) const
+{
+   vector<string> Files;
+   if (FileList(Files) == false)
+      return false;
+
+   for (vector<string>::const_iterator I = Files.begin(); I != Files.end(); ++I)
+   {
+      std::string_view const File(*I);
+      std::string_view::size_type const Slash = File.rfind('/');
+      if (Slash == std::string_view::npos)
+	 continue;
+      auto const Dir = Wanted.find(File.substr(0,Slash+1));
+      if (Dir == Wanted.end())
+	 continue;
+      auto const Base = Dir->second.find(File.substr(Slash+1));
+      if (Base != Dir->second.end())
+	 Found.push_back(Base->second);
+   }
+   return true;
+}
+
 bool RPMHandler::InternalDep(const char *name, const char *ver, raptDepFlags flag) const
 {
    static const char rpmlib_prefix[] = "rpmlib(";
@@ -107,9 +148,20 @@ bool RPMHandler::InternalDep(const char *name, const char *ver, raptDepFlags fla
    return rpmCheckRpmlibProvides(name, ver, flag);
 }
 
+bool RPMHandler::PRCO(unsigned int Type, vector<Dependency*> &Deps,
+		      bool checkInternalDep) const
+{
+   DepArena Arena;
+   if (PRCO(Type, Arena, checkInternalDep) == false)
+      return false;
+   for (DepArena::const_iterator I = Arena.begin(); I != Arena.end(); ++I)
+      Deps.push_back(new Dependency(*I));
+   return true;
+}
+
 bool RPMHandler::PutDep(const char *name, const char *ver, raptDepFlags flags,
 			unsigned int Type, bool checkInternalDep,
-			vector<Dependency*> &Deps) const
+			DepArena &Deps) const
 {
    if (checkInternalDep && InternalDep(name, ver, flags))
       return true;
@@ -123,12 +175,11 @@ bool RPMHandler::PutDep(const char *name, const char *ver, raptDepFlags flags,
          Type = pkgCache::Dep::Depends;
    }
 
-   Dependency *Dep = new Dependency;
-   Dep->Name = name;
-   Dep->Version = ver;
-   Dep->Op = DepOp(flags);
-   Dep->Type = Type;
-   Deps.push_back(Dep);
+   Dependency &Dep = Deps.Add();
+   Dep.Name = name;
+   Dep.Version = ver;
+   Dep.Op = DepOp(flags);
+   Dep.Type = Type;
    return true;
 }
 
@@ -150,8 +201,17 @@ string RPMHdrHandler::GetSTag(raptTag Tag) const
    return str;
 }
 
-bool RPMHdrHandler::PRCO(unsigned int Type, vector<Dependency*> &Deps,
-			     bool checkInternalDep) const
+// The string stays in the header, which we hold until the next Skip()
+std::string_view RPMHdrHandler::GetSTagView(raptTag Tag) const
+{
+   const char *str = NULL;
+   if (HeaderP != NULL)
+      str = headerGetString(HeaderP, Tag);
+   return str == NULL ? std::string_view() : std::string_view(str);
+}
+
+bool RPMHdrHandler::PRCO(unsigned int Type, DepArena &Deps,
+			 bool checkInternalDep) const
 {
    rpmTag deptype;
    switch (Type) {
@@ -193,6 +253,49 @@ bool RPMHdrHandler::FileList(vector<string> &FileList) const
    return true;
 }
 
+// Looks up the directory of every file once, and none of the names are
+// put together unless they are wanted.
+bool RPMHdrHandler::FindFiles(const pkgCacheGenerator::FileDepIndex &Wanted,
+			      vector<const char *> &Found) const
+{
+   struct rpmtd_s Bases, Dirs, Indexes;
+   // Headers with the old style file names, or no files at all
+   if (!headerGet(HeaderP, RPMTAG_BASENAMES, &Bases, HEADERGET_MINMEM))
+      return RPMHandler::FindFiles(Wanted, Found);
+   if (!headerGet(HeaderP, RPMTAG_DIRNAMES, &Dirs, HEADERGET_MINMEM)) {
+      rpmtdFreeData(&Bases);
+      return true;
+   }
+   if (!headerGet(HeaderP, RPMTAG_DIRINDEXES, &Indexes, HEADERGET_MINMEM)) {
+      rpmtdFreeData(&Dirs);
+      rpmtdFreeData(&Bases);
+      return true;
+   }
+
+   vector<const pkgCacheGenerator::FileDepBases *> DirFiles;
+   DirFiles.reserve(rpmtdCount(&Dirs));
+   const char *Name;
+   while ((Name = rpmtdNextString(&Dirs)) != NULL) {
+      auto const Dir = Wanted.find(Name);
+      DirFiles.push_back(Dir == Wanted.end() ? NULL : &Dir->second);
+   }
+
+   raptInt *Index;
+   while ((Name = rpmtdNextString(&Bases)) != NULL &&
+	  (Index = rpmtdNextUint32(&Indexes)) != NULL) {
+      if (*Index >= DirFiles.size() || DirFiles[*Index] == NULL)
+	 continue;
+      auto const Base = DirFiles[*Index]->find(Name);
+      if (Base != DirFiles[*Index]->end())
+	 Found.push_back(Base->second);
+   }
+
+   rpmtdFreeData(&Indexes);
+   rpmtdFreeData(&Dirs);
+   rpmtdFreeData(&Bases);
+   return true;
+}
+
 string RPMHdrHandler::Changelog() const
 {
    string str;
@@ -238,7 +341,8 @@ string RPMHdrHandler::Packager() const
    return string("");
 }
 
-RPMFileHandler::RPMFileHandler(const string &File)
+RPMFileHandler::RPMFileHandler(const string &File, bool Map)
+   : Mapped(NULL), Position(0)
 {
    ID = File;
    FD = Fopen(File.c_str(), "r");
@@ -251,9 +355,12 @@ RPMFileHandler::RPMFileHandler(const string &File)
       return;
    }
    iSize = fdSize(FD);
+   if (Map == true)
+      MapFile();
 }
 
 RPMFileHandler::RPMFileHandler(FileFd *File)
+   : Mapped(NULL), Position(0)
 {
    FD = fdDup(File->Fd());
    if (FD == NULL)
@@ -265,23 +372,75 @@ RPMFileHandler::RPMFileHandler(FileFd *File)
       return;
    }
    iSize = fdSize(FD);
+   MapFile();
 }
 
 RPMFileHandler::~RPMFileHandler()
 {
    if (HeaderP != NULL)
       headerFree(HeaderP);
+   if (Mapped != NULL)
+      munmap((void *)Mapped, iSize);
    if (FD != NULL)
       Fclose(FD);
 }
 
+// Lists are uncompressed once they are fetched, so they can be mapped as
+// a whole. Whatever can't be (pipes, empty lists) is still read from FD.
+void RPMFileHandler::MapFile()
+{
+   if (iSize <= 0)
+      return;
+   void *Base = mmap(NULL, iSize, PROT_READ, MAP_PRIVATE, Fileno(FD), 0);
+   if (Base != MAP_FAILED)
+      Mapped = (const unsigned char *)Base;
+}
+
+// Headers in a list are stored with their magic, which is followed by
+// the number of index entries and the size of the data in network order.
+Header RPMFileHandler::ImportHeader()
+{
+   static const unsigned char Magic[] = {0x8e, 0xad, 0xe8, 0x01, 0, 0, 0, 0};
+   uint32_t Entries, DataSize;
+
+   iOffset = Position;
+   if (Position < 0 || iSize - Position < (off_t)(sizeof(Magic) + 8))
+      return NULL;
+   const unsigned char *P = Mapped + Position;
+   if (memcmp(P, Magic, sizeof(Magic)) != 0)
+      return NULL;
+   P += sizeof(Magic);
+   memcpy(&Entries, P, sizeof(Entries));
+   memcpy(&DataSize, P + sizeof(Entries), sizeof(DataSize));
+   Entries = ntohl(Entries);
+   DataSize = ntohl(DataSize);
+
+   // The same limits rpm applies when reading
+   if (Entries > 0xffff || DataSize > 0x0fffffff)
+      return NULL;
+   off_t Size = 8 + (off_t)Entries * 16 + DataSize;
+   if (Size > iSize - Position - (off_t)sizeof(Magic))
+      return NULL;
+
+   /* The header owns and eventually frees the blob it is given, so it
+      gets a copy of the mapped one, which still saves the reads. */
+   Header H = headerImport((void *)P, Size, HEADERIMPORT_COPY);
+   if (H != NULL)
+      Position += sizeof(Magic) + Size;
+   return H;
+}
+
 bool RPMFileHandler::Skip()
 {
    if (FD == NULL)
       return false;
-   iOffset = lseek(Fileno(FD),0,SEEK_CUR);
    if (HeaderP != NULL)
        headerFree(HeaderP);
+   if (Mapped != NULL) {
+      HeaderP = ImportHeader();
+      return (HeaderP != NULL);
+   }
+   iOffset = lseek(Fileno(FD),0,SEEK_CUR);
    HeaderP = headerRead(FD, HEADER_MAGIC_YES);
    return (HeaderP != NULL);
 }
@@ -290,7 +449,9 @@ bool RPMFileHandler::Jump(off_t Offset)
 {
    if (FD == NULL)
       return false;
-   if (lseek(Fileno(FD),Offset,SEEK_SET) != Offset)
+   if (Mapped != NULL)
+      Position = Offset;
+   else if (lseek(Fileno(FD),Offset,SEEK_SET) != Offset)
       return false;
    return Skip();
 }
@@ -299,6 +460,10 @@ void RPMFileHandler::Rewind()
 {
    if (FD == NULL)
       return;
+   if (Mapped != NULL) {
+      Position = iOffset = 0;
+      return;
+   }
    iOffset = lseek(Fileno(FD),0,SEEK_SET);
    if (iOffset != 0)
       _error->Error(_("could not rewind RPMFileHandler"));
@@ -350,42 +515,352 @@ off_t RPMSingleFileHandler::FileSize() const
    return S.st_size;
 }
 
+// FileDigest - Digest of a package file, each file being read once	/*{{{*/
+// ---------------------------------------------------------------------
+/* All the digests APT knows of are computed in the same pass over the
+   file, and kept for as long as the process runs, keyed by the device,
+   inode, size and modification time, to the nanosecond, of the file,
+   so a file rewritten within the same second is read again. Asking for
+   both the MD5 and the BLAKE2b of a file, or for either of them again,
+   reads the file only the first time. */
+static string FileDigest(const string &Path, const string &Type)
+{
+   typedef std::tuple<dev_t,ino_t,off_t,time_t,long> Key;
+   static std::map<Key,std::map<string,string> > Known;
+   static std::mutex Lock;
+
+   FileFd File(Path, FileFd::ReadOnly);
+   struct stat St;
+   if (File.IsOpen() == false || fstat(File.Fd(), &St) != 0)
+      return "";
+   const Key K(St.st_dev, St.st_ino, St.st_size, St.st_mtime,
+		St.st_mtim.tv_nsec);
+   {
+      std::lock_guard<std::mutex> Guard(Lock);
+      auto I = Known.find(K);
+      if (I != Known.end())
+	 return I->second[Type];
+   }
+
+   Hashes Hash;
+   if (Hash.AddFD(File.Fd(), St.st_size) == false)
+      return "";
+   std::map<string,string> Digests;
+   for (HashContainer::iterator I = Hash.HashSet.begin();
+	I != Hash.HashSet.end(); ++I)
+      Digests[I->Type()] = I->Result();
+
+   std::lock_guard<std::mutex> Guard(Lock);
+   return (Known[K] = Digests)[Type];
+}
+									/*}}}*/
 string RPMSingleFileHandler::MD5Sum() const
 {
-   MD5Summation MD5;
-   FileFd File(sFilePath, FileFd::ReadOnly);
-   MD5.AddFD(File.Fd(), File.Size());
-   File.Close();
-   return MD5.Result();
+   return FileDigest(sFilePath, "MD5-Hash");
 }
 
 string RPMSingleFileHandler::BLAKE2b() const
 {
-   raptHash blake2b = raptHash("BLAKE2b");
-   FileFd File(sFilePath, FileFd::ReadOnly);
-   blake2b.AddFD(File.Fd(), File.Size());
-   File.Close();
-   return blake2b.Result();
+   return FileDigest(sFilePath, "BLAKE2b");
 }
 
+// RPMDirHandler::HeaderCache - Headers already read from a directory	/*{{{*/
+// ---------------------------------------------------------------------
+/* The headers of the last complete pass over a directory are kept in
+   Dir::Cache::rpmdir, one exported header blob per package file keyed by
+   its device, inode, size and modification time to the nanosecond. A
+   file which has none of them changed is never read again. The cache is only an optimisation, so any
+   trouble with it is silently ignored and the files are read instead. */
+class RPMDirHandler::HeaderCache
+{
+   static constexpr char Magic[8] = {'A','P','T','R','D','I','R','2'};
+
+   struct Record
+   {
+      uint64_t Dev;
+      uint64_t Ino;
+      uint64_t Size;
+      int64_t MTime;
+      int64_t MTimeNsec;
+      uint32_t NameLen;
+      uint32_t BlobLen;
+   };
+
+   struct Blob
+   {
+      Record Key;
+      const unsigned char *Data;
+   };
+
+   string Path;
+   const unsigned char *Map;
+   size_t MapSize;
+   std::unordered_map<std::string_view,Blob> Blobs;
+
+   // The cache written during a pass in order, renamed over Path at its end
+   string TmpPath;
+   int Out;
+   unsigned long Written;
+   bool Changed;
+
+   static Record Key(const Entry &E)
+   {
+      Record R;
+      memset(&R,0,sizeof(R));
+      R.Dev = E.Dev;
+      R.Ino = E.Ino;
+      R.Size = E.Size;
+      R.MTime = E.MTime;
+      R.MTimeNsec = E.MTimeNsec;
+      return R;
+   }
+
+   static bool Same(const Record &A,const Record &B)
+   {
+      return A.Dev == B.Dev && A.Ino == B.Ino && A.Size == B.Size &&
+	     A.MTime == B.MTime && A.MTimeNsec == B.MTimeNsec;
+   }
+
+   bool Write(const void *Buf,size_t Len)
+   {
+      const char *P = (const char *)Buf;
+      while (Len != 0)
+      {
+	 ssize_t Res = write(Out,P,Len);
+	 if (Res < 0 && errno == EINTR)
+	    continue;
+	 if (Res <= 0)
+	    return false;
+	 P += Res;
+	 Len -= Res;
+      }
+      return true;
+   }
+
+   void Load()
+   {
+      int Fd = open(Path.c_str(),O_RDONLY);
+      if (Fd < 0)
+	 return;
+      struct stat St;
+      if (fstat(Fd,&St) == 0 && St.st_size > (off_t)sizeof(Magic))
+      {
+	 void *P = mmap(NULL,St.st_size,PROT_READ,MAP_PRIVATE,Fd,0);
+	 if (P != MAP_FAILED)
+	 {
+	    Map = (const unsigned char *)P;
+	    MapSize = St.st_size;
+	 }
+      }
+      close(Fd);
+      if (Map == NULL || memcmp(Map,Magic,sizeof(Magic)) != 0)
+	 return;
+
+      size_t Pos = sizeof(Magic);
+      while (MapSize - Pos >= sizeof(Record))
+      {
+	 Record R;
+	 memcpy(&R,Map + Pos,sizeof(R));
+	 Pos += sizeof(R);
+	 if (R.NameLen > MapSize - Pos || R.BlobLen > MapSize - Pos - R.NameLen)
+	    break;
+	 Blob B = {R,Map + Pos + R.NameLen};
+	 Blobs[std::string_view((const char *)Map + Pos,R.NameLen)] = B;
+	 Pos += R.NameLen + R.BlobLen;
+      }
+      // A truncated file is taken as is, the rest is read again
+   }
+
+   public:
+
+   // Returns a copy of the header kept for E, or NULL. Safe to call from
+   // several threads at once.
+   Header Find(const Entry &E) const
+   {
+      auto I = Blobs.find(E.Name);
+      if (I == Blobs.end() || Same(I->second.Key,Key(E)) == false)
+	 return NULL;
+      return headerImport((void *)I->second.Data,I->second.Key.BlobLen,
+			  HEADERIMPORT_COPY);
+   }
+
+   // Starts writing the cache for a pass from the first entry
+   void Begin()
+   {
+      Abort();
+      TmpPath = Path + ".XXXXXX";
+      Out = mkstemp(&TmpPath[0]);
+      if (Out < 0)
+	 return;
+      Written = 0;
+      Changed = false;
+      if (Write(Magic,sizeof(Magic)) == false)
+	 Abort();
+   }
+
+   // Appends the header of the next entry read in the pass
+   void Add(const Entry &E,Header H)
+   {
+      if (Out < 0)
+	 return;
+      auto I = Blobs.find(E.Name);
+      if (I == Blobs.end() || Same(I->second.Key,Key(E)) == false)
+	 Changed = true;
+
+      unsigned int Len = 0;
+      void *Data = headerExport(H,&Len);
+      if (Data == NULL)
+      {
+	 Abort();
+	 return;
+      }
+      Record R = Key(E);
+      R.NameLen = E.Name.length();
+      R.BlobLen = Len;
+      bool Res = Write(&R,sizeof(R)) && Write(E.Name.c_str(),R.NameLen) &&
+		 Write(Data,Len);
+      free(Data);
+      if (Res == false)
+      {
+	 Abort();
+	 return;
+      }
+      Written++;
+   }
+
+   // Drops the cache of a pass which was left before its end
+   void Abort()
+   {
+      if (Out < 0)
+	 return;
+      close(Out);
+      unlink(TmpPath.c_str());
+      Out = -1;
+   }
+
+   // The pass is over, replaces the old cache if anything differs
+   void Commit()
+   {
+      if (Out < 0)
+	 return;
+      if (Changed == false && Written == Blobs.size())
+      {
+	 Abort();
+	 return;
+      }
+      if (close(Out) != 0 || rename(TmpPath.c_str(),Path.c_str()) != 0)
+	 unlink(TmpPath.c_str());
+      Out = -1;
+   }
+
+   HeaderCache(const string &Path) : Path(Path), Map(NULL), MapSize(0),
+				      Out(-1), Written(0), Changed(false)
+   {
+      Load();
+   }
+   ~HeaderCache()
+   {
+      Abort();
+      if (Map != NULL)
+	 munmap((void *)Map,MapSize);
+   }
+};
+constexpr char RPMDirHandler::HeaderCache::Magic[8];
+									/*}}}*/
+// RPMDirHandler::Loader - Read headers ahead on worker threads		/*{{{*/
+// ---------------------------------------------------------------------
+/* Each worker reads the next entry nobody has taken yet, using its own
+   transaction set, while at most a window of two headers per thread is
+   kept waiting for Skip(). */
+class RPMDirHandler::Loader
+{
+   const RPMDirHandler &Owner;
+   vector<Header> Headers;
+   vector<bool> Ready;
+   vector<Entry>::size_type Next;
+   vector<Entry>::size_type Taken;
+   vector<Entry>::size_type Window;
+   bool Stop;
+
+   std::mutex Lock;
+   std::condition_variable Cond;
+   vector<std::thread> Workers;
+
+   void Work()
+   {
+      rpmts TS = rpmtsCreate();
+      rpmtsSetVSFlags(TS, (rpmVSFlags_e)-1);
+
+      std::unique_lock<std::mutex> Guard(Lock);
+      while (true)
+      {
+	 Cond.wait(Guard,[this] {
+	    return Stop == true || Next == Headers.size() ||
+		   Next < Taken + Window;});
+	 if (Stop == true || Next == Headers.size())
+	    break;
+
+	 const auto Item = Next++;
+	 Guard.unlock();
+	 Header H = Owner.ReadHeader(Item,TS);
+	 Guard.lock();
+
+	 Headers[Item] = H;
+	 Ready[Item] = true;
+	 Cond.notify_all();
+      }
+      Guard.unlock();
+      rpmtsFree(TS);
+   }
+
+   public:
+
+   // Blocks until the entry at Pos is read, NULL if it is no package
+   Header Take(vector<Entry>::size_type Pos)
+   {
+      std::unique_lock<std::mutex> Guard(Lock);
+      Cond.wait(Guard,[this,Pos] {return Ready[Pos] == true;});
+      Header H = Headers[Pos];
+      Headers[Pos] = NULL;
+      Taken = Pos + 1;
+      Cond.notify_all();
+      return H;
+   }
+
+   Loader(const RPMDirHandler &Owner,unsigned int Threads) :
+      Owner(Owner), Headers(Owner.Entries.size(),NULL),
+      Ready(Owner.Entries.size(),false), Next(0), Taken(0),
+      Window(2*Threads), Stop(false)
+   {
+      for (unsigned int I = 0; I != Threads; I++)
+	 Workers.push_back(std::thread(&Loader::Work,this));
+   }
+   ~Loader()
+   {
+      {
+	 std::lock_guard<std::mutex> Guard(Lock);
+	 Stop = true;
+      }
+      Cond.notify_all();
+      for (vector<std::thread>::iterator I = Workers.begin();
+	   I != Workers.end(); I++)
+	 I->join();
+      for (vector<Header>::iterator I = Headers.begin();
+	   I != Headers.end(); I++)
+	 if (*I != NULL)
+	    headerFree(*I);
+   }
+};
+									/*}}}*/
+
 RPMDirHandler::RPMDirHandler(const string &DirName)
-   : sDirName(DirName)
+   : Listed(false), sDirName(DirName), Current(0), Sequential(true)
 {
    ID = DirName;
    TS = NULL;
-   Dir = opendir(sDirName.c_str());
+   DIR *Dir = opendir(sDirName.c_str());
    if (Dir == NULL)
       return;
-   iSize = 0;
-   while (nextFileName() != NULL)
-      iSize += 1;
-   rewinddir(Dir);
-   TS = rpmtsCreate();
-   rpmtsSetVSFlags(TS, (rpmVSFlags_e)-1);
-}
-
-const char *RPMDirHandler::nextFileName()
-{
    for (struct dirent *Ent = readdir(Dir); Ent != 0; Ent = readdir(Dir))
    {
       const char *name = Ent->d_name;
@@ -397,82 +872,143 @@ const char *RPMDirHandler::nextFileName()
 	 continue;
 
       // Make sure it is a file and not something else
-      sFilePath = flCombine(sDirName,name);
       struct stat St;
-      if (stat(sFilePath.c_str(),&St) != 0 || S_ISREG(St.st_mode) == 0)
+      if (stat(flCombine(sDirName,name).c_str(),&St) != 0 ||
+	  S_ISREG(St.st_mode) == 0)
 	 continue;
 
-      sFileName = name;
+      Entry E = {name,St.st_dev,St.st_ino,St.st_size,St.st_mtime,
+		 St.st_mtim.tv_nsec};
+      Entries.push_back(E);
+   }
+   closedir(Dir);
+   Listed = true;
+   iSize = Entries.size();
 
-      return name;
+   string CacheFile = CachePath(sDirName);
+   if (CacheFile.empty() == false)
+   {
+      mkdir(flNotFile(CacheFile).c_str(),0755);
+      Cache.reset(new HeaderCache(CacheFile));
    }
-   return NULL;
+
+   TS = rpmtsCreate();
+   rpmtsSetVSFlags(TS, (rpmVSFlags_e)-1);
 }
 
 RPMDirHandler::~RPMDirHandler()
 {
+   Stop();
    if (HeaderP != NULL)
       headerFree(HeaderP);
    if (TS != NULL)
       rpmtsFree(TS);
-   if (Dir != NULL)
-      closedir(Dir);
 }
 
+// RPMDirHandler::CachePath - Where the headers of a directory are kept	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+string RPMDirHandler::CachePath(const string &DirName)
+{
+   if (_config->Find("Dir::Cache::rpmdir").empty() == true)
+      return "";
+   return _config->FindDir("Dir::Cache::rpmdir") + URItoFileName(DirName);
+}
+									/*}}}*/
+// RPMDirHandler::ReadHeader - Header of the entry at Pos		/*{{{*/
+// ---------------------------------------------------------------------
+/* Called by the loader threads as well, so this must only read. */
+Header RPMDirHandler::ReadHeader(vector<Entry>::size_type Pos, rpmts TS) const
+{
+   const Entry &E = Entries[Pos];
+   Header H = NULL;
+   if (Cache != nullptr && (H = Cache->Find(E)) != NULL)
+      return H;
+
+   string Path = flCombine(sDirName,E.Name);
+   FD_t FD = Fopen(Path.c_str(), "r");
+   if (FD == NULL)
+      return NULL;
+   int rc = rpmReadPackageFile(TS, FD, E.Name.c_str(), &H);
+   Fclose(FD);
+   if (rc != RPMRC_OK
+       && rc != RPMRC_NOTTRUSTED
+       && rc != RPMRC_NOKEY)
+      return NULL;
+   return H;
+}
+									/*}}}*/
+// RPMDirHandler::Stop - Leave the current pass				/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void RPMDirHandler::Stop()
+{
+   Pool.reset();
+   if (Cache != nullptr)
+      Cache->Abort();
+   Sequential = false;
+}
+									/*}}}*/
 bool RPMDirHandler::Skip()
 {
-   if (Dir == NULL)
+   if (Listed == false)
       return false;
    if (HeaderP != NULL) {
       headerFree(HeaderP);
       HeaderP = NULL;
    }
-   const char *fname = nextFileName();
-   bool Res = false;
-   for (; fname != NULL; fname = nextFileName()) {
-      iOffset++;
-      if (fname == NULL)
-	 break;
-      FD_t FD = Fopen(sFilePath.c_str(), "r");
-      if (FD == NULL)
-	 continue;
-      int rc = rpmReadPackageFile(TS, FD, fname, &HeaderP);
-      Fclose(FD);
-      if (rc != RPMRC_OK
-	  && rc != RPMRC_NOTTRUSTED
-	  && rc != RPMRC_NOKEY)
+
+   if (Current == 0 && Sequential == true)
+   {
+      if (Cache != nullptr)
+	 Cache->Begin();
+      const int Threads = _config->FindI("APT::Cache-Threads",1);
+      if (Threads > 1 && Entries.size() > 1)
+	 Pool.reset(new Loader(*this,Threads));
+   }
+
+   while (Current < Entries.size()) {
+      const vector<Entry>::size_type Pos = Current++;
+      iOffset = Pos + 1;
+      sFileName = Entries[Pos].Name;
+      sFilePath = flCombine(sDirName,sFileName);
+      HeaderP = (Pool != nullptr) ? Pool->Take(Pos) : ReadHeader(Pos,TS);
+      if (HeaderP == NULL)
 	 continue;
-      Res = true;
-      break;
+      if (Sequential == true && Cache != nullptr)
+	 Cache->Add(Entries[Pos],HeaderP);
+      return true;
    }
-   return Res;
+
+   if (Sequential == true && Cache != nullptr)
+      Cache->Commit();
+   Pool.reset();
+   Sequential = false;
+   return false;
 }
 
 bool RPMDirHandler::Jump(off_t Offset)
 {
-   if (Dir == NULL)
+   if (Listed == false)
       return false;
-   rewinddir(Dir);
-   iOffset = 0;
-   while (1) {
-      if (iOffset+1 == Offset)
-	 return Skip();
-      if (nextFileName() == NULL)
-	 break;
-      iOffset++;
-   }
-   return false;
+   Stop();
+   if (Offset < 1 || Offset > (off_t)Entries.size())
+      return false;
+   Current = Offset - 1;
+   return Skip();
 }
 
 void RPMDirHandler::Rewind()
 {
-   rewinddir(Dir);
+   Stop();
+   Current = 0;
    iOffset = 0;
+   Sequential = true;
 }
 
 off_t RPMDirHandler::FileSize() const
 {
-   if (Dir == NULL)
+   if (Listed == false)
       return 0;
    struct stat St;
    if (stat(sFilePath.c_str(),&St) != 0) {
@@ -484,24 +1020,16 @@ off_t RPMDirHandler::FileSize() const
 
 string RPMDirHandler::MD5Sum() const
 {
-   if (Dir == NULL)
+   if (Listed == false)
       return "";
-   MD5Summation MD5;
-   FileFd File(sFilePath, FileFd::ReadOnly);
-   MD5.AddFD(File.Fd(), File.Size());
-   File.Close();
-   return MD5.Result();
+   return FileDigest(sFilePath, "MD5-Hash");
 }
 
 string RPMDirHandler::BLAKE2b() const
 {
-   if (Dir == NULL)
+   if (Listed == false)
       return "";
-   raptHash blake2b = raptHash("BLAKE2b");
-   FileFd File(sFilePath, FileFd::ReadOnly);
-   blake2b.AddFD(File.Fd(), File.Size());
-   File.Close();
-   return blake2b.Result();
+   return FileDigest(sFilePath, "BLAKE2b");
 }
 
 
@@ -653,6 +1181,296 @@ void RPMDBHandler::Rewind()
    RpmIter = raptInitIterator(Handler, RPMDBI_PACKAGES, NULL, 0);
    iOffset = 0;
 }
+
+static void CopyPRCO(const RPMHandler &Source, unsigned int Type,
+		     DepArena &Deps, vector<Dependency> &Out)
+{
+   Deps.Clear();
+   Source.PRCO(Type, Deps, true);
+   Out.assign(Deps.begin(), Deps.end());
+}
+
+RPMPreparsedHandler::RPMPreparsedHandler(RPMHandler &Source)
+   : Current(0), Database(Source.IsDatabase()),
+     Ordered(Source.OrderedOffset()), ProvideName(Source.ProvideFileName()),
+     Texts(_config->FindB("APT::Cache-Texts",false))
+{
+   ID = Source.GetID();
+   iSize = Source.Size();
+
+   DepArena Deps;
+   Source.Rewind();
+   while (Source.Skip() == true) {
+      Records.push_back(Record());
+      Record &R = Records.back();
+      R.Offset = Source.Offset();
+      R.Name = Source.Name();
+      R.Arch = Source.Arch();
+      R.Version = Source.Version();
+      R.EVRDB = Source.EVRDB();
+      R.Group = Source.Group();
+      R.FileName = Source.FileName();
+      R.Directory = Source.Directory();
+      if (Texts == true) {
+	 R.Summary = Source.SummaryView();
+	 R.Description = Source.DescriptionView();
+	 R.Packager = Source.Packager();
+      }
+      R.FileSize = Source.FileSize();
+      R.InstalledSize = Source.InstalledSize();
+      R.AutoInstalled = Source.AutoInstalled();
+      CopyPRCO(Source, pkgCache::Dep::Depends, Deps, R.Depends);
+      CopyPRCO(Source, pkgCache::Dep::Conflicts, Deps, R.Conflicts);
+      CopyPRCO(Source, pkgCache::Dep::Obsoletes, Deps, R.Obsoletes);
+      CopyPRCO(Source, pkgCache::Dep::Provides, Deps, R.Provides);
+   }
+}
+
+bool RPMPreparsedHandler::Skip()
+{
+   if (Current == Records.size())
+      return false;
+   iOffset = Records[Current++].Offset;
+   return true;
+}
+
+bool RPMPreparsedHandler::Jump(off_t Offset)
+{
+   for (Current = 0; Current != Records.size(); Current++)
+      if (Records[Current].Offset == Offset)
+	 return Skip();
+   return false;
+}
+
+void RPMPreparsedHandler::Rewind()
+{
+   Current = 0;
+   iOffset = 0;
+}
+
+bool RPMPreparsedHandler::PRCO(unsigned int Type, DepArena &Deps,
+			       bool checkInternalDep) const
+{
+   const vector<Dependency> *List;
+   switch (Type) {
+      case pkgCache::Dep::Depends:
+	 List = &Cur().Depends;
+	 break;
+      case pkgCache::Dep::Conflicts:
+	 List = &Cur().Conflicts;
+	 break;
+      case pkgCache::Dep::Obsoletes:
+	 List = &Cur().Obsoletes;
+	 break;
+      case pkgCache::Dep::Provides:
+	 List = &Cur().Provides;
+	 break;
+      default:
+	 return false;
+   }
+   for (vector<Dependency>::const_iterator I = List->begin(); I != List->end(); ++I)
+      Deps.Add() = *I;
+   return true;
+}
+
+// The records are kept as a flat list of fixed width integers and
+// length prefixed strings, in the native byte order since the file is
+// only ever read back on the same host.
+static const char PreparsedMagic[8] = {'A','P','T','P','R','S','D','3'};
+
+static void PutInt(string &Buf, int64_t Value)
+{
+   Buf.append((const char *)&Value, sizeof(Value));
+}
+
+static void PutStr(string &Buf, const string &Value)
+{
+   PutInt(Buf, Value.length());
+   Buf.append(Value);
+}
+
+static void PutDeps(string &Buf, const vector<Dependency> &Deps)
+{
+   PutInt(Buf, Deps.size());
+   for (vector<Dependency>::const_iterator I = Deps.begin(); I != Deps.end(); ++I) {
+      PutStr(Buf, I->Name);
+      PutStr(Buf, I->Version);
+      PutInt(Buf, I->Op);
+      PutInt(Buf, I->Type);
+   }
+}
+
+// Reads the values back, failing once anything would run past the end
+struct PreparsedReader
+{
+   const char *Pos;
+   const char *End;
+
+   bool Int(int64_t &Value)
+   {
+      if ((size_t)(End - Pos) < sizeof(Value))
+	 return false;
+      memcpy(&Value, Pos, sizeof(Value));
+      Pos += sizeof(Value);
+      return true;
+   }
+
+   template<typename T> bool Num(T &Value)
+   {
+      int64_t V;
+      if (Int(V) == false)
+	 return false;
+      Value = V;
+      return true;
+   }
+
+   bool Str(string &Value)
+   {
+      int64_t Len;
+      if (Int(Len) == false || Len < 0 || Len > End - Pos)
+	 return false;
+      Value.assign(Pos, Len);
+      Pos += Len;
+      return true;
+   }
+
+   bool Deps(vector<Dependency> &Deps)
+   {
+      int64_t Count;
+      if (Int(Count) == false || Count < 0 || Count > End - Pos)
+	 return false;
+      Deps.resize(Count);
+      for (vector<Dependency>::iterator I = Deps.begin(); I != Deps.end(); ++I)
+	 if (Str(I->Name) == false || Str(I->Version) == false ||
+	     Num(I->Op) == false || Num(I->Type) == false)
+	    return false;
+      return true;
+   }
+};
+
+// RPMPreparsedHandler::Save - Keep the records for the next build	/*{{{*/
+// ---------------------------------------------------------------------
+/* The file is written aside and renamed into place, so that a reader
+   never sees it half written. Failing to write it is not an error, the
+   index file is just decoded again the next time. */
+bool RPMPreparsedHandler::Save(const string &File, const struct stat &Index) const
+{
+   string Buf(PreparsedMagic, sizeof(PreparsedMagic));
+   PutInt(Buf, _system->OptionsHash());
+   PutStr(Buf, ID);
+   PutInt(Buf, Index.st_size);
+   PutInt(Buf, Index.st_mtime);
+   PutInt(Buf, Index.st_mtim.tv_nsec);
+   PutInt(Buf, iSize);
+   PutInt(Buf, Database);
+   PutInt(Buf, Ordered);
+   PutInt(Buf, ProvideName);
+   PutInt(Buf, Texts);
+   PutInt(Buf, Records.size());
+   for (vector<Record>::const_iterator R = Records.begin(); R != Records.end(); ++R) {
+      PutInt(Buf, R->Offset);
+      PutStr(Buf, R->Name);
+      PutStr(Buf, R->Arch);
+      PutStr(Buf, R->Version);
+      PutStr(Buf, R->EVRDB);
+      PutStr(Buf, R->Group);
+      PutStr(Buf, R->FileName);
+      PutStr(Buf, R->Directory);
+      PutStr(Buf, R->Summary);
+      PutStr(Buf, R->Description);
+      PutStr(Buf, R->Packager);
+      PutInt(Buf, R->FileSize);
+      PutInt(Buf, R->InstalledSize);
+      PutInt(Buf, R->AutoInstalled);
+      PutDeps(Buf, R->Depends);
+      PutDeps(Buf, R->Conflicts);
+      PutDeps(Buf, R->Obsoletes);
+      PutDeps(Buf, R->Provides);
+   }
+
+   string Tmp = File + ".XXXXXX";
+   int Fd = mkstemp(&Tmp[0]);
+   if (Fd < 0)
+      return false;
+   fchmod(Fd,0644);
+   const char *P = Buf.data();
+   size_t Left = Buf.size();
+   while (Left != 0) {
+      ssize_t Res = write(Fd, P, Left);
+      if (Res < 0 && errno == EINTR)
+	 continue;
+      if (Res <= 0)
+	 break;
+      P += Res;
+      Left -= Res;
+   }
+   if (close(Fd) != 0 || Left != 0 || rename(Tmp.c_str(), File.c_str()) != 0) {
+      unlink(Tmp.c_str());
+      return false;
+   }
+   return true;
+}
+									/*}}}*/
+// RPMPreparsedHandler::Load - Read back the records kept by Save	/*{{{*/
+// ---------------------------------------------------------------------
+/* Only the index file the records were decoded from, unchanged since,
+   is accepted, and only under the options and the locale the cache was
+   built with, which decide on APT::Cache-Texts and the language of the
+   groups and texts. Anything else, including a damaged file, gives
+   NULL. */
+RPMPreparsedHandler *RPMPreparsedHandler::Load(const string &File,
+					       const string &ID,
+					       const struct stat &Index)
+{
+   int Fd = open(File.c_str(), O_RDONLY);
+   if (Fd < 0)
+      return NULL;
+   struct stat St;
+   if (fstat(Fd, &St) != 0 || St.st_size < (off_t)sizeof(PreparsedMagic)) {
+      close(Fd);
+      return NULL;
+   }
+   void *Map = mmap(NULL, St.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+   close(Fd);
+   if (Map == MAP_FAILED)
+      return NULL;
+
+   PreparsedReader In = {(const char *)Map, (const char *)Map + St.st_size};
+   std::unique_ptr<RPMPreparsedHandler> Handler(new RPMPreparsedHandler());
+   string FileID;
+   int64_t Options, Size, MTime, MNano, Count;
+   bool Res = memcmp(In.Pos, PreparsedMagic, sizeof(PreparsedMagic)) == 0;
+   In.Pos += sizeof(PreparsedMagic);
+   Res = Res && In.Int(Options) && Options == (int64_t)_system->OptionsHash() &&
+	 In.Str(FileID) && FileID == ID &&
+	 In.Int(Size) && Size == Index.st_size &&
+	 In.Int(MTime) && MTime == Index.st_mtime &&
+	 In.Int(MNano) && MNano == Index.st_mtim.tv_nsec &&
+	 In.Num(Handler->iSize) && In.Num(Handler->Database) &&
+	 In.Num(Handler->Ordered) && In.Num(Handler->ProvideName) &&
+	 In.Num(Handler->Texts) &&
+	 Handler->Texts == _config->FindB("APT::Cache-Texts",false) &&
+	 In.Int(Count) && Count >= 0 && Count <= St.st_size;
+   if (Res == true)
+      Handler->Records.resize(Count);
+   for (vector<Record>::iterator R = Handler->Records.begin();
+	Res == true && R != Handler->Records.end(); ++R)
+      Res = In.Num(R->Offset) && In.Str(R->Name) && In.Str(R->Arch) &&
+	    In.Str(R->Version) && In.Str(R->EVRDB) && In.Str(R->Group) &&
+	    In.Str(R->FileName) && In.Str(R->Directory) &&
+	    In.Str(R->Summary) && In.Str(R->Description) &&
+	    In.Str(R->Packager) && In.Num(R->FileSize) && In.Num(R->InstalledSize) &&
+	    In.Num(R->AutoInstalled) && In.Deps(R->Depends) &&
+	    In.Deps(R->Conflicts) && In.Deps(R->Obsoletes) &&
+	    In.Deps(R->Provides);
+   munmap(Map, St.st_size);
+
+   if (Res == false || In.Pos != In.End)
+      return NULL;
+   Handler->ID = ID;
+   return Handler.release();
+}
+									/*}}}*/
 #endif
 
 // vim:sts=3:sw=3
@@ -11,15 +11,19 @@
 #define PKGLIB_RPMHANDLER_H
 
 #include <apt-pkg/fileutl.h>
+#include <apt-pkg/pkgcachegen.h>
 
 #include <rpm/rpmlib.h>
 #include <rpm/rpmmacro.h>
 #include "rapttypes.h"
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 
+#include <memory>
 #include <vector>
+#include <string_view>
 
 // Our Extra RPM tags. These should not be accessed directly. Use
 // the methods in RPMHandler instead.
@@ -40,6 +44,32 @@ struct Dependency
    unsigned int Type;
 };
 
+// The dependencies of one header. Entries are kept when it is cleared, so
+// filling it again for the next header reuses their strings.
+class DepArena
+{
+   std::vector<Dependency> Items;
+   std::vector<Dependency>::size_type Used;
+
+   public:
+
+   typedef std::vector<Dependency>::const_iterator const_iterator;
+
+   inline Dependency &Add()
+   {
+      if (Used == Items.size())
+	 Items.emplace_back();
+      return Items[Used++];
+   }
+   inline void Clear() {Used = 0;}
+   inline bool empty() const {return Used == 0;}
+   inline std::vector<Dependency>::size_type size() const {return Used;}
+   inline const_iterator begin() const {return Items.begin();}
+   inline const_iterator end() const {return Items.begin() + Used;}
+
+   DepArena() : Used(0) {}
+};
+
 class RPMHandler
 {
    protected:
@@ -52,7 +82,7 @@ class RPMHandler
    bool InternalDep(const char *name, const char *ver, raptDepFlags flag) const;
    bool PutDep(const char *name, const char *ver, raptDepFlags flags,
 	       unsigned int type, bool checkInternalDep,
-	       std::vector<Dependency*> &Deps) const;
+	       DepArena &Deps) const;
 
    public:
 
@@ -87,8 +117,20 @@ class RPMHandler
    virtual off_t InstalledSize() const = 0;
    virtual string SourceRpm() const = 0;
 
-   virtual bool PRCO(unsigned int Type, std::vector<Dependency*> &Deps,
+   // The same without copying, only valid until the handler moves on
+   virtual std::string_view NameView() const = 0;
+   virtual std::string_view ArchView() const = 0;
+   virtual std::string_view VersionView() const = 0;
+   virtual std::string_view GroupView() const = 0;
+   virtual std::string_view SummaryView() const = 0;
+   virtual std::string_view DescriptionView() const = 0;
+
+   // Appends the dependencies of the kind Type to Deps
+   virtual bool PRCO(unsigned int Type, DepArena &Deps,
                      bool checkInternalDep) const = 0;
+   // The same, with each dependency allocated for the caller to delete
+   bool PRCO(unsigned int Type, std::vector<Dependency*> &Deps,
+	     bool checkInternalDep) const;
    /* a virtual method with default parameter is confusing; instead, define: */
    bool PRCO(const unsigned int Type, std::vector<Dependency*> &Deps) const
    { return PRCO(Type,Deps,true); }
@@ -96,6 +138,9 @@ class RPMHandler
    virtual string Changelog() const = 0;
 
    virtual bool HasFile(const char *File) const;
+   // Appends the names, from Wanted, of the files in the package
+   virtual bool FindFiles(const pkgCacheGenerator::FileDepIndex &Wanted,
+			  std::vector<const char *> &Found) const;
 
    RPMHandler() : iOffset(0), iSize(0) {}
    virtual ~RPMHandler() {}
@@ -108,6 +153,7 @@ class RPMHdrHandler : public RPMHandler
    Header HeaderP;
 
    string GetSTag(raptTag Tag) const;
+   std::string_view GetSTagView(raptTag Tag) const;
    off_t GetITag(raptTag Tag) const;
 
    public:
@@ -116,21 +162,31 @@ class RPMHdrHandler : public RPMHandler
    virtual string Directory() const override {return "";}
    virtual off_t FileSize() const override {return 1;}
 
-   virtual string Name() const override {return GetSTag(RPMTAG_NAME);}
-   virtual string Arch() const override {return GetSTag(RPMTAG_ARCH);}
-   virtual string Version() const override {return GetSTag(RPMTAG_VERSION);}
+   virtual string Name() const override {return string(NameView());}
+   virtual string Arch() const override {return string(ArchView());}
+   virtual string Version() const override {return string(VersionView());}
    virtual string EVRDB() const override;
-   virtual string Group() const override {return GetSTag(RPMTAG_GROUP);}
+   virtual string Group() const override {return string(GroupView());}
    virtual string Packager() const override;
-   virtual string Summary() const override {return GetSTag(RPMTAG_SUMMARY);}
-   virtual string Description() const override {return GetSTag(RPMTAG_DESCRIPTION);}
+   virtual string Summary() const override {return string(SummaryView());}
+   virtual string Description() const override {return string(DescriptionView());}
    virtual bool AutoInstalled() const override {return GetITag(RPMTAG_AUTOINSTALLED);}
    virtual off_t InstalledSize() const override {return GetITag(RPMTAG_SIZE);}
    virtual string SourceRpm() const override {return GetSTag(RPMTAG_SOURCERPM);}
 
-   virtual bool PRCO(unsigned int Type, std::vector<Dependency*> &Deps,
+   virtual std::string_view NameView() const override {return GetSTagView(RPMTAG_NAME);}
+   virtual std::string_view ArchView() const override {return GetSTagView(RPMTAG_ARCH);}
+   virtual std::string_view VersionView() const override {return GetSTagView(RPMTAG_VERSION);}
+   virtual std::string_view GroupView() const override {return GetSTagView(RPMTAG_GROUP);}
+   virtual std::string_view SummaryView() const override {return GetSTagView(RPMTAG_SUMMARY);}
+   virtual std::string_view DescriptionView() const override {return GetSTagView(RPMTAG_DESCRIPTION);}
+
+   virtual bool PRCO(unsigned int Type, DepArena &Deps,
                      bool checkInternalDep) const override;
+   using RPMHandler::PRCO;
    virtual bool FileList(std::vector<string> &FileList) const override;
+   virtual bool FindFiles(const pkgCacheGenerator::FileDepIndex &Wanted,
+			  std::vector<const char *> &Found) const override;
    virtual string Changelog() const override;
 
    RPMHdrHandler() : RPMHandler(), HeaderP(0) {}
@@ -144,6 +200,14 @@ class RPMFileHandler : public RPMHdrHandler
 
    FD_t FD;
 
+   // The whole list when it could be mapped, headers are then imported
+   // from it instead of being read through FD.
+   const unsigned char *Mapped;
+   off_t Position;
+
+   void MapFile();
+   Header ImportHeader();
+
    public:
 
    virtual bool Skip() override;
@@ -157,7 +221,7 @@ class RPMFileHandler : public RPMHdrHandler
    virtual string BLAKE2b() const override {return GetSTag(CRPMTAG_BLAKE2B);}
 
    RPMFileHandler(FileFd *File);
-   RPMFileHandler(const string &File);
+   RPMFileHandler(const string &File, bool Map = true);
    virtual ~RPMFileHandler();
 };
 
@@ -180,7 +244,7 @@ class RPMSingleFileHandler : public RPMFileHandler
    virtual string BLAKE2b() const override;
    virtual bool ProvideFileName() const override {return true;}
 
-   RPMSingleFileHandler(const string &File) : RPMFileHandler(File), sFilePath(File) {}
+   RPMSingleFileHandler(const string &File) : RPMFileHandler(File, false), sFilePath(File) {}
    virtual ~RPMSingleFileHandler() {}
 };
 
@@ -222,22 +286,50 @@ class RPMDirHandler : public RPMHdrHandler
 {
    protected:
 
-   DIR *Dir;
+   // A package file, as listed when the handler was created
+   struct Entry
+   {
+      string Name;
+      dev_t Dev;
+      ino_t Ino;
+      off_t Size;
+      time_t MTime;
+      long MTimeNsec;
+   };
+
+   // Headers already read from the directory, see rpmhandler.cc
+   class HeaderCache;
+   // Reads the headers ahead on APT::Cache-Threads worker threads
+   class Loader;
+
+   bool Listed;
    string sDirName;
    string sFileName;
    string sFilePath;
 
+   std::vector<Entry> Entries;
+   std::vector<Entry>::size_type Current;
+   // Whether every entry so far was visited in order from the first
+   bool Sequential;
+
+   std::unique_ptr<HeaderCache> Cache;
+   std::unique_ptr<Loader> Pool;
+
    rpmts TS;
 
-   const char *nextFileName();
+   Header ReadHeader(std::vector<Entry>::size_type Pos, rpmts TS) const;
+   void Stop();
 
    public:
 
+   // Where the headers of DirName are kept, empty if they are not
+   static string CachePath(const string &DirName);
+
    virtual bool Skip() override;
    virtual bool Jump(off_t Offset) override;
    virtual void Rewind() override;
 
-   virtual string FileName() const override {return (Dir == NULL)?"":sFileName;}
+   virtual string FileName() const override {return (Listed == false)?"":sFileName;}
    virtual off_t FileSize() const override;
    virtual string MD5Sum() const override;
    virtual string BLAKE2b() const override;
@@ -246,5 +338,101 @@ class RPMDirHandler : public RPMHdrHandler
    virtual ~RPMDirHandler();
 };
 
+// Holds the fields the cache generator needs from every header of
+// another handler, decoded in advance. Building it touches neither the
+// cache nor RPMPackageData, so it may be done on a worker thread.
+class RPMPreparsedHandler : public RPMHandler
+{
+   protected:
+
+   struct Record
+   {
+      off_t Offset;
+      string Name;
+      string Arch;
+      string Version;
+      string EVRDB;
+      string Group;
+      string FileName;
+      string Directory;
+      // Only kept with APT::Cache-Texts
+      string Summary;
+      string Description;
+      string Packager;
+      off_t FileSize;
+      off_t InstalledSize;
+      bool AutoInstalled;
+      std::vector<Dependency> Depends;
+      std::vector<Dependency> Conflicts;
+      std::vector<Dependency> Obsoletes;
+      std::vector<Dependency> Provides;
+   };
+
+   std::vector<Record> Records;
+   std::vector<Record>::size_type Current;
+   bool Database;
+   bool Ordered;
+   bool ProvideName;
+   bool Texts;
+
+   inline const Record &Cur() const {return Records[Current-1];}
+
+   RPMPreparsedHandler() : Current(0), Database(false), Ordered(true),
+			   ProvideName(false), Texts(false) {}
+
+   public:
+
+   virtual bool Skip() override;
+   virtual bool Jump(off_t Offset) override;
+   virtual void Rewind() override;
+   virtual bool OrderedOffset() const override {return Ordered;}
+   virtual bool IsDatabase() const override {return Database;}
+
+   virtual string FileName() const override {return Cur().FileName;}
+   virtual string Directory() const override {return Cur().Directory;}
+   virtual off_t FileSize() const override {return Cur().FileSize;}
+   virtual bool ProvideFileName() const override {return ProvideName;}
+
+   virtual string Name() const override {return Cur().Name;}
+   virtual string Arch() const override {return Cur().Arch;}
+   virtual string Version() const override {return Cur().Version;}
+   virtual string EVRDB() const override {return Cur().EVRDB;}
+   virtual string Group() const override {return Cur().Group;}
+   virtual bool AutoInstalled() const override {return Cur().AutoInstalled;}
+   virtual off_t InstalledSize() const override {return Cur().InstalledSize;}
+
+   virtual std::string_view NameView() const override {return Cur().Name;}
+   virtual std::string_view ArchView() const override {return Cur().Arch;}
+   virtual std::string_view VersionView() const override {return Cur().Version;}
+   virtual std::string_view GroupView() const override {return Cur().Group;}
+   virtual std::string_view SummaryView() const override {return Cur().Summary;}
+   virtual std::string_view DescriptionView() const override {return Cur().Description;}
+   virtual string Packager() const override {return Cur().Packager;}
+   virtual string Summary() const override {return Cur().Summary;}
+   virtual string Description() const override {return Cur().Description;}
+
+   // Not needed for generating the cache, so not kept.
+   virtual string MD5Sum() const override {return "";}
+   virtual string BLAKE2b() const override {return "";}
+   virtual string SourceRpm() const override {return "";}
+   virtual string Changelog() const override {return "";}
+   virtual bool FileList(std::vector<string> &FileList) const override {return true;}
+
+   // Internal dependencies are always filtered out here.
+   virtual bool PRCO(unsigned int Type, DepArena &Deps,
+                     bool checkInternalDep) const override;
+   using RPMHandler::PRCO;
+
+   // Keeps the records in File, for the index file described by Index.
+   bool Save(const string &File, const struct stat &Index) const;
+   // The records kept by Save() for this very index file, or NULL.
+   static RPMPreparsedHandler *Load(const string &File, const string &ID,
+				    const struct stat &Index);
+
+   // Reads all of Source, which is left at its end.
+   RPMPreparsedHandler(RPMHandler &Source);
+   virtual ~RPMPreparsedHandler() {}
+};
+
 #endif
 // vim:sts=3:sw=3
@@ -31,6 +31,8 @@
 #include <apti18n.h>
 
 #include <sys/stat.h>
+#include <dirent.h>
+#include <set>
 									/*}}}*/
 vector<pkgRepository *> RepList;
 
@@ -361,7 +363,9 @@ bool rpmPkgListIndex::GetIndexes(pkgAcquire *Owner) const
 bool rpmPkgListIndex::Merge(pkgCacheGenerator &Gen,OpProgress &Prog) const
 {
    string PackageFile = IndexPath();
-   RPMHandler *Handler = CreateHandler();
+   RPMHandler *Handler = Preparsed ? Preparsed.release() : CreateParsedHandler();
+   if (Handler == NULL)
+      Handler = CreateHandler();
 
    Prog.SubProgress(0,Info(MainType()));
    ::URI Tmp(URI);
@@ -412,6 +416,67 @@ bool rpmPkgListIndex::Merge(pkgCacheGenerator &Gen,OpProgress &Prog) const
    return true;
 }
 									/*}}}*/
+// PkgListIndex::Preparse - Decode the index ahead of Merge		/*{{{*/
+// ---------------------------------------------------------------------
+/* Runs on a worker thread of the cache generator. Any error raised while
+   decoding stays in this thread's error list, and then nothing is kept so
+   that Merge() reads the file again and reports it properly. */
+void rpmPkgListIndex::Preparse() const
+{
+   Preparsed.reset();
+   std::unique_ptr<RPMHandler> Result(CreateParsedHandler());
+   if (Result == nullptr && _error->PendingError() == false)
+   {
+      std::unique_ptr<RPMHandler> Handler(CreateHandler());
+      if (_error->PendingError() == true)
+	 return;
+      Result.reset(new RPMPreparsedHandler(*Handler));
+   }
+   if (_error->PendingError() == true)
+      return;
+   Preparsed = std::move(Result);
+}
+									/*}}}*/
+// PkgListIndex::ParsedPath - Where the decoded index is kept		/*{{{*/
+// ---------------------------------------------------------------------
+/* In Dir::Cache::parsed, under the name of the index file, which is
+   already unique among the lists. */
+string rpmPkgListIndex::ParsedPath() const
+{
+   if (_config->Find("Dir::Cache::parsed").empty() == true)
+      return "";
+   return _config->FindDir("Dir::Cache::parsed") + flNotDir(IndexPath());
+}
+									/*}}}*/
+// PkgListIndex::CreateParsedHandler - Decoded index, kept across builds/*{{{*/
+// ---------------------------------------------------------------------
+/* The headers of an index file which did not change since the last
+   build are not decoded again, its records are read back from
+   ParsedPath(). Otherwise they are decoded and kept there for the next
+   build. Returns NULL if there is no such place or decoding failed. */
+RPMHandler *rpmPkgListIndex::CreateParsedHandler() const
+{
+   string Parsed = ParsedPath();
+   struct stat St;
+   if (Parsed.empty() == true || stat(IndexPath().c_str(),&St) != 0)
+      return NULL;
+
+   RPMHandler *Kept = RPMPreparsedHandler::Load(Parsed,IndexPath(),St);
+   if (Kept != NULL)
+      return Kept;
+
+   std::unique_ptr<RPMHandler> Handler(CreateHandler());
+   if (_error->PendingError() == true)
+      return NULL;
+   std::unique_ptr<RPMPreparsedHandler> Result(new RPMPreparsedHandler(*Handler));
+   if (_error->PendingError() == true)
+      return NULL;
+
+   mkdir(flNotFile(Parsed).c_str(),0755);
+   Result->Save(Parsed,St);
+   return Result.release();
+}
+									/*}}}*/
 // PkgListIndex::MergeFileProvides - Process file dependencies if any	/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -509,6 +574,36 @@ unsigned long rpmSrcDirIndex::Size() const
    return Res;
 }
 
+									/*}}}*/
+// PruneDirCaches - Remove the header caches of unlisted directories	/*{{{*/
+// ---------------------------------------------------------------------
+/* RPMDirHandler keeps the headers of each rpm-dir source in a file of its
+   own, which nothing else would remove once the source is gone. */
+bool rpmPruneDirCaches(const pkgSourceList &List)
+{
+   if (_config->Find("Dir::Cache::rpmdir").empty() == true)
+      return true;
+   string CacheDir = _config->FindDir("Dir::Cache::rpmdir");
+   DIR *D = opendir(CacheDir.c_str());
+   if (D == 0)
+      return true;
+
+   std::set<string> Kept;
+   for (pkgSourceList::const_iterator I = List.begin(); I != List.end(); ++I)
+      if (dynamic_cast<rpmPkgDirIndex *>(*I) != 0 ||
+	  dynamic_cast<rpmSrcDirIndex *>(*I) != 0)
+	 Kept.insert(flNotDir(RPMDirHandler::CachePath(::URI((*I)->ArchiveURI("")).Path)));
+
+   for (struct dirent *Ent = readdir(D); Ent != 0; Ent = readdir(D))
+   {
+      if (strcmp(Ent->d_name,".") == 0 || strcmp(Ent->d_name,"..") == 0)
+	 continue;
+      if (Kept.find(Ent->d_name) == Kept.end())
+	 unlink(flCombine(CacheDir,Ent->d_name).c_str());
+   }
+   closedir(D);
+   return true;
+}
 									/*}}}*/
 // SinglePkgIndex::ArchiveURI - URI for the archive		        /*{{{*/
 // ---------------------------------------------------------------------
@@ -19,9 +19,12 @@
 #include <apt-pkg/indexfile.h>
 #include "rpmhandler.h"
 
+#include <memory>
+
 class RPMHandler;
 class RPMDBHandler;
 class pkgRepository;
+class pkgSourceList;
 
 class rpmIndexFile : public pkgIndexFile
 {
@@ -101,8 +104,15 @@ class rpmPkgListIndex : public rpmListIndex
 {
    protected:
 
+   // Filled in by Preparse() and taken over by the next Merge()
+   mutable std::unique_ptr<RPMHandler> Preparsed;
+
    virtual string MainType() const override {return "pkglist";}
 
+   // Where the decoded index is kept between builds, blank if nowhere
+   virtual string ParsedPath() const;
+   RPMHandler *CreateParsedHandler() const;
+
    public:
 
    virtual const Type *GetType() const override;
@@ -124,6 +134,8 @@ class rpmPkgListIndex : public rpmListIndex
    virtual bool MergeFileProvides(pkgCacheGenerator &/*Gen*/,
 				  OpProgress &/*Prog*/) const override;
    virtual pkgCache::PkgFileIterator FindInCache(pkgCache &Cache) const override;
+   virtual void Preparse() const override;
+   virtual void DropPreparsed() const override {Preparsed.reset();}
 
    rpmPkgListIndex(const string &URI, const string &Dist, const string &Section,
 		   pkgRepository *Repository) :
@@ -170,6 +182,8 @@ class rpmPkgDirIndex : public rpmPkgListIndex
    virtual string MainType() const override {return "pkgdir";}
    virtual string IndexPath() const override;
    virtual string ReleasePath() const override;
+   // The headers are kept by RPMDirHandler itself
+   virtual string ParsedPath() const override {return "";}
 
    public:
 
@@ -226,6 +240,7 @@ class rpmSinglePkgIndex : public rpmPkgListIndex
 
    virtual string MainType() const override {return "pkg";}
    virtual string IndexPath() const override {return FilePath;}
+   virtual string ParsedPath() const override {return "";}
 
    public:
 
@@ -270,4 +285,7 @@ class rpmSingleSrcIndex : public rpmSrcListIndex
 	   rpmSrcListIndex("", "", "", NULL), FilePath(File) {}
 };
 
+// Removes the headers kept for rpm-dir sources which are not in List
+bool rpmPruneDirCaches(const pkgSourceList &List);
+
 #endif
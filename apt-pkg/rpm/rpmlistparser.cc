@@ -40,7 +40,8 @@ string MultilibArchs[] = {"x86_64", "ia64", "ppc64", "sparc64"};
 // ---------------------------------------------------------------------
 /* */
 rpmListParser::rpmListParser(RPMHandler *Handler)
-	: Handler(Handler), VI(0)
+	: Handler(Handler), VI(0), LoadedDeps(0), FailedDeps(0),
+	  Texts(_config->FindB("APT::Cache-Texts",false))
 {
    Handler->Rewind();
    if (Handler->IsDatabase() == true)
@@ -64,6 +65,11 @@ rpmListParser::~rpmListParser()
 // ---------------------------------------------------------------------
 /* This is to return the name of the package this section describes */
 string rpmListParser::Package()
+{
+   return CurPackage();
+}
+
+const string &rpmListParser::CurPackage()
 {
    if (CurrentName.empty() == false)
       return CurrentName;
@@ -77,19 +83,17 @@ string rpmListParser::Package()
 
    Duplicated = false;
 
-   string Name = Handler->Name();
+   string Name(Handler->NameView());
    if (Name.empty())
    {
       _error->Error(_("Corrupt pkglist: no RPMTAG_NAME in header entry"));
-      return "";
+      return CurrentName;
    }
 
    bool IsDup = false;
 
-   if (RpmData->IsMultilibSys() && RpmData->IsCompatArch(Architecture())) {
+   if (RpmData->IsMultilibSys() && RpmData->IsCompatArch(CurArch()))
 	 Name += ".32bit";
-	 CurrentName = Name;
-   }
 
 
    // If this package can have multiple versions installed at
@@ -124,11 +128,12 @@ string rpmListParser::Package()
    }
    if (IsDup == true)
    {
-      Name += "#"+Version();
+      Name += '#';
+      Name += CurVersion();
       Duplicated = true;
    }
    CurrentName = Name;
-   return Name;
+   return CurrentName;
 }
 
                                                                         /*}}}*/
@@ -136,12 +141,23 @@ string rpmListParser::Package()
 // ---------------------------------------------------------------------
 string rpmListParser::Architecture()
 {
+   return CurArch();
+}
+
+const string &rpmListParser::CurArch()
+{
+   if (CurrentArch.empty() == false)
+      return CurrentArch;
+
 #ifdef WITH_VERSION_CACHING
-   if (VI != NULL)
-      return VI->Arch();
+   if (VI != NULL) {
+      CurrentArch = VI->Arch();
+      return CurrentArch;
+   }
 #endif
 
-   return Handler->Arch();
+   CurrentArch = Handler->ArchView();
+   return CurrentArch;
 }
                                                                         /*}}}*/
 
@@ -154,12 +170,23 @@ string rpmListParser::Architecture()
  entry is assumed to only describe package properties */
 string rpmListParser::Version()
 {
+   return CurVersion();
+}
+
+const string &rpmListParser::CurVersion()
+{
+   if (CurrentVersion.empty() == false)
+      return CurrentVersion;
+
 #ifdef WITH_VERSION_CACHING
-   if (VI != NULL)
-      return VI->VerStr();
+   if (VI != NULL) {
+      CurrentVersion = VI->VerStr();
+      return CurrentVersion;
+   }
 #endif
 
-   return Handler->EVRDB();
+   CurrentVersion = Handler->EVRDB();
+   return CurrentVersion;
 }
                                                                         /*}}}*/
 // ListParser::NewVersion - Fill in the version structure		/*{{{*/
@@ -174,8 +201,9 @@ bool rpmListParser::NewVersion(pkgCache::VerIterator &Ver)
 
    // Parse the section
    {
-      const auto idxSection = WriteUniqString(Handler->Group());
-      const auto idxArch = WriteUniqString(Handler->Arch());
+      std::string_view const Group = Handler->GroupView();
+      const auto idxSection = WriteUniqString(Group.data(), Group.size());
+      const auto idxArch = WriteUniqString(CurArch());
       if ((!idxSection) || (!idxArch))
          return false;
 
@@ -183,6 +211,22 @@ bool rpmListParser::NewVersion(pkgCache::VerIterator &Ver)
       Ver->Arch = *idxArch;
    }
 
+   // The texts frontends list, so that they need not read the records
+   if (Texts == true)
+   {
+      std::string_view const Summary = Handler->SummaryView();
+      std::string_view const Description = Handler->DescriptionView();
+      const auto idxSummary = WriteString(Summary.data(), Summary.size());
+      const auto idxDescription = WriteString(Description.data(), Description.size());
+      const auto idxPackager = WriteString(Handler->Packager());
+      if ((!idxSummary) || (!idxDescription) || (!idxPackager))
+         return false;
+
+      Ver->Summary = *idxSummary;
+      Ver->Description = *idxDescription;
+      Ver->Packager = *idxPackager;
+   }
+
    // Archive Size
    Ver->Size = (unsigned long long)Handler->FileSize();
 
@@ -218,7 +262,8 @@ bool rpmListParser::UsePackage(pkgCache::PkgIterator &Pkg,
       SeenPackages->insert(PkgName);
    if (Pkg->Section == 0)
    {
-      const auto idxSection = WriteUniqString(Handler->Group());
+      std::string_view const Group = Handler->GroupView();
+      const auto idxSection = WriteUniqString(Group.data(), Group.size());
       if (!idxSection)
          return false;
 
@@ -253,6 +298,41 @@ static bool depuniq(const Dependency *a, const Dependency *b)
    return a->Name == b->Name;
 }
 
+// ListParser::CurDeps - Dependencies of the current header		/*{{{*/
+// ---------------------------------------------------------------------
+/* Returns NULL if the handler couldn't extract them. */
+const DepArena *rpmListParser::CurDeps(unsigned int Type)
+{
+   unsigned int Slot;
+   switch (Type) {
+      case pkgCache::Dep::Depends:
+	 Slot = 0;
+	 break;
+      case pkgCache::Dep::Conflicts:
+	 Slot = 1;
+	 break;
+      case pkgCache::Dep::Obsoletes:
+	 Slot = 2;
+	 break;
+      case pkgCache::Dep::Provides:
+	 Slot = 3;
+	 break;
+      default:
+	 return NULL;
+   }
+
+   if ((LoadedDeps & (1 << Slot)) == 0) {
+      LoadedDeps |= 1 << Slot;
+      Deps[Slot].Clear();
+      if (!Handler->PRCO(Type, Deps[Slot], true))
+	 FailedDeps |= 1 << Slot;
+   }
+   if ((FailedDeps & (1 << Slot)) != 0)
+      return NULL;
+   return &Deps[Slot];
+}
+									/*}}}*/
+
 unsigned short rpmListParser::VersionHash()
 {
 #ifdef WITH_VERSION_CACHING
@@ -261,9 +341,9 @@ unsigned short rpmListParser::VersionHash()
 #endif
 
    unsigned long Result = INIT_FCS;
-   Result = AddCRC16(Result, Package());
-   Result = AddCRC16(Result, Version());
-   Result = AddCRC16(Result, Architecture());
+   Result = AddCRC16(Result, CurPackage());
+   Result = AddCRC16(Result, CurVersion());
+   Result = AddCRC16(Result, CurArch());
 
    int DepSections[] = {
       pkgCache::Dep::Depends,
@@ -272,24 +352,22 @@ unsigned short rpmListParser::VersionHash()
    };
 
    for (size_t i = 0; i < sizeof(DepSections)/sizeof(int); ++i) {
-      vector<Dependency*> Deps;
-
-      if (!Handler->PRCO(DepSections[i], Deps))
+      const DepArena *Deps = CurDeps(DepSections[i]);
+      if (Deps == NULL)
 	 continue;
 
-      std::sort(Deps.begin(), Deps.end(), depsort);
+      SortedDeps.clear();
+      for (DepArena::const_iterator I = Deps->begin(); I != Deps->end(); ++I)
+	 SortedDeps.push_back(&*I);
+      std::sort(SortedDeps.begin(), SortedDeps.end(), depsort);
 
       // Rpmdb can give out dupes for scriptlet dependencies, filter them out.
       // XXX Why is this done here instead of the handler?
-      vector<Dependency*> UniqDeps;
-      UniqDeps.assign(Deps.begin(), Deps.end());
-      vector<Dependency*>::const_iterator DepEnd =
-	 std::unique(UniqDeps.begin(), UniqDeps.end(), depuniq);
+      vector<const Dependency*>::const_iterator DepEnd =
+	 std::unique(SortedDeps.begin(), SortedDeps.end(), depuniq);
 
-      for (vector<Dependency*>::const_iterator I = UniqDeps.begin(); I != DepEnd; ++I)
+      for (vector<const Dependency*>::const_iterator I = SortedDeps.begin(); I != DepEnd; ++I)
 	 Result = AddCRC16(Result, (*I)->Name);
-      for (vector<Dependency*>::const_iterator I = Deps.begin(); I != Deps.end(); ++I)
-	 delete (*I);
    }
    return Result;
 }
@@ -320,16 +398,14 @@ bool rpmListParser::ParseStatus(pkgCache::PkgIterator &Pkg,
  a complete depends tree for the given version. */
 bool rpmListParser::ParseDepends(pkgCache::VerIterator &Ver, unsigned int Type)
 {
-   vector<Dependency*> Deps;
-
-   if (!Handler->PRCO(Type, Deps))
+   const DepArena *Deps = CurDeps(Type);
+   if (Deps == NULL)
       return false;
 
    bool rc = true;
-   for (vector<Dependency*>::const_iterator I = Deps.begin(); I != Deps.end(); ++I) {
-      if (!NewDepends(Ver, (*I)->Name, (*I)->Version, (*I)->Op, (*I)->Type))
+   for (DepArena::const_iterator I = Deps->begin(); I != Deps->end(); ++I) {
+      if (!NewDepends(Ver, I->Name, I->Version, I->Op, I->Type))
 	 rc = false;
-      delete (*I);
    }
 
    return rc;
@@ -338,32 +414,27 @@ bool rpmListParser::ParseDepends(pkgCache::VerIterator &Ver, unsigned int Type)
 bool rpmListParser::CollectFileProvides(pkgCache &Cache,
 					pkgCache::VerIterator &Ver)
 {
-   vector<string> Files;
+   vector<const char *> Files;
 
-   if (!Handler->FileList(Files))
+   // Only the files which some package is named after are of interest
+   if (!Handler->FindFiles(Owner->GetFileDeps(), Files))
       return false;
+   if (Files.empty() == true)
+      return true;
 
-   bool ret = true;
-   for (vector<string>::const_iterator I = Files.begin(); I != Files.end(); ++I) {
-      const char *FileName = (*I).c_str();
-      pkgCache::Package *P = Cache.FindPackage(FileName);
-      if (P != NULL) {
-	 // Check if this is already provided.
-	 bool Found = false;
-	 for (pkgCache::PrvIterator Prv = Ver.ProvidesList();
-	      Prv.end() == false; Prv++) {
-	    if (strcmp(Prv.Name(), FileName) == 0) {
-	       Found = true;
-	       break;
-	    }
-	 }
-	 if (Found == false && NewProvides(Ver, FileName, "") == false) {
-	    ret = false;
-	    break;
-	 }
-      }
+   // What is already provided, by the index of the provided package
+   unordered_set<map_ptrloc> Provided;
+   for (pkgCache::PrvIterator Prv = Ver.ProvidesList(); Prv.end() == false; Prv++)
+      Provided.insert(Prv->ParentPkg);
+
+   for (vector<const char *>::const_iterator I = Files.begin(); I != Files.end(); ++I) {
+      pkgCache::Package *P = Cache.FindPackage(*I);
+      if (P == NULL || Provided.insert(P - Cache.PkgP).second == false)
+	 continue;
+      if (NewProvides(Ver, *I, "") == false)
+	 return false;
    }
-   return ret;
+   return true;
 }
 
 // ListParser::ParseProvides - Parse the provides list			/*{{{*/
@@ -371,16 +442,14 @@ bool rpmListParser::CollectFileProvides(pkgCache &Cache,
 /* */
 bool rpmListParser::ParseProvides(pkgCache::VerIterator &Ver)
 {
-   vector<Dependency*> Deps;
-
-   if (!Handler->PRCO(pkgCache::Dep::Provides, Deps))
+   const DepArena *Deps = CurDeps(pkgCache::Dep::Provides);
+   if (Deps == NULL)
       return false;
 
    bool rc = true;
-   for (vector<Dependency*>::const_iterator I = Deps.begin(); I != Deps.end(); ++I) {
-      if (!NewProvides(Ver,(*I)->Name,(*I)->Version))
+   for (DepArena::const_iterator I = Deps->begin(); I != Deps->end(); ++I) {
+      if (!NewProvides(Ver,I->Name,I->Version))
 	 rc = false;
-      delete (*I);
    }
 
    return rc;
@@ -393,7 +462,10 @@ bool rpmListParser::Step()
 {
    while (Handler->Skip() == true)
    {
-      CurrentName = "";
+      CurrentName.clear();
+      CurrentVersion.clear();
+      CurrentArch.clear();
+      LoadedDeps = FailedDeps = 0;
 
 #ifdef WITH_VERSION_CACHING
       VI = RpmData->GetVersion(Handler->GetID(), Offset());
@@ -401,15 +473,17 @@ bool rpmListParser::Step()
 	 return true;
 #endif
 
-      string RealName = Package();
+      const string &Name = CurPackage();
 
-      if (Duplicated == true)
-	 RealName = RealName.substr(0,RealName.find('#'));
-      if (RpmData->IgnorePackage(RealName) == true)
+      if (Duplicated == true) {
+	 if (RpmData->IgnorePackage(Name.substr(0,Name.find('#'))) == true)
+	    continue;
+      }
+      else if (RpmData->IgnorePackage(Name) == true)
 	 continue;
 
       if (Handler->IsDatabase() == true ||
-	  RpmData->ArchScore(Architecture()) > 0)
+	  RpmData->ArchScore(CurArch()) > 0)
 	 return true;
    }
    return false;
@@ -566,6 +640,9 @@ void rpmListParser::VirtualizePackage(const string &Name)
       FromVer->NextVer = 0;
    }
 
+   // The versions merged from other files were moved as well.
+   Owner->GetCache().HeaderP->MovedVersions = true;
+
    // Reset original package data.
    FromPkgI->CurrentVer = 0;
    FromPkgI->VersionList = 0;
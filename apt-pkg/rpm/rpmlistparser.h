@@ -34,14 +34,32 @@ class rpmListParser : public pkgCacheGenerator::ListParser
    RPMHandler *Handler;
    RPMPackageData *RpmData;
 
+   // The fields of the current header, fetched once each
    string CurrentName;
+   string CurrentVersion;
+   string CurrentArch;
    const pkgCache::VerIterator *VI;
 
+   // Dependencies of the current header, by kind, extracted once for
+   // both VersionHash() and the cache. The arenas are reused.
+   DepArena Deps[4];
+   unsigned int LoadedDeps;
+   unsigned int FailedDeps;
+   vector<const Dependency *> SortedDeps;
+   const DepArena *CurDeps(unsigned int Type);
+
    typedef std::unordered_set<std::string> SeenPackagesType;
    SeenPackagesType *SeenPackages;
 
    bool Duplicated;
 
+   // Whether summaries and descriptions are kept in the cache
+   bool Texts;
+
+   const string &CurPackage();
+   const string &CurVersion();
+   const string &CurArch();
+
    bool ParseStatus(pkgCache::PkgIterator &Pkg,pkgCache::VerIterator &Ver);
    bool ParseDepends(pkgCache::VerIterator &Ver, unsigned int Type);
    bool ParseProvides(pkgCache::VerIterator &Ver);
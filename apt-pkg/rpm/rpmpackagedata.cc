@@ -319,9 +319,8 @@ bool RPMPackageData::IsDupPackage(const string &Name)
 
 RPMPackageData *RPMPackageData::Singleton()
 {
-   static RPMPackageData *data = NULL;
-   if (!data)
-      data = new RPMPackageData();
+   // Built once even when first needed on several threads
+   static RPMPackageData *data = new RPMPackageData();
    return data;
 }
 
@@ -27,7 +27,7 @@
 // ---------------------------------------------------------------------
 /* */
 rpmRecordParser::rpmRecordParser(const string &File, pkgCache &Cache)
-   : Handler(0), Buffer(0), BufSize(0), BufUsed(0)
+   : Handler(0)
 {
    if (File == RPMDBHandler::DataPath(false)) {
       IsDatabase = true;
@@ -53,7 +53,6 @@ rpmRecordParser::~rpmRecordParser()
    // could already have been destroyed.
    if (IsDatabase == false)
       delete Handler;
-   free(Buffer);
 }
 									/*}}}*/
 // RecordParser::Jump - Jump to a specific record			/*{{{*/
@@ -109,7 +108,7 @@ string rpmRecordParser::Maintainer()
 /* */
 string rpmRecordParser::ShortDesc()
 {
-   return Handler->Summary();
+   return string(Handler->SummaryView());
 }
 									/*}}}*/
 // RecordParser::LongDesc - Return a longer description			/*{{{*/
@@ -117,7 +116,7 @@ string rpmRecordParser::ShortDesc()
 /* */
 string rpmRecordParser::LongDesc()
 {
-   return Handler->Description();
+   return string(Handler->DescriptionView());
 }
 									/*}}}*/
 // RecordParser::Changelog - Return package changelog if any		/*{{{*/
@@ -137,128 +136,112 @@ string rpmRecordParser::SourcePkg()
 }
 									/*}}}*/
 
-void rpmRecordParser::BufCat(const char *text)
+static inline void BufCatTag(string &Out, const char *tag,
+			     std::string_view value)
 {
-   if (text != NULL)
-      BufCat(text, text+strlen(text));
+   Out += tag;
+   Out += value;
 }
 
-void rpmRecordParser::BufCat(const char *begin, const char *end)
+static void BufCatNum(string &Out, const char *tag, unsigned long long value)
 {
-   unsigned len = end - begin;
-
-   while (BufUsed + len + 1 >= BufSize)
-   {
-      size_t new_size = BufSize + 512;
-      char *new_buf = (char*)realloc(Buffer, new_size);
-      if (new_buf == NULL)
-      {
-	 _error->Errno("realloc", _("Could not allocate buffer for record text"));
-	 return;
-      }
-      Buffer = new_buf;
-      BufSize = new_size;
-   }
-
-   memcpy(Buffer+BufUsed, begin, len);
-   BufUsed += len;
-   Buffer[BufUsed] = '\0';
-}
-
-void rpmRecordParser::BufCatTag(const char *tag, const char *value)
-{
-   BufCat(tag);
-   BufCat(value);
+   char buf[32];
+   char *p = buf + sizeof(buf);
+   do {
+      *--p = '0' + value % 10;
+      value /= 10;
+   } while (value != 0);
+   Out += tag;
+   Out.append(p, buf + sizeof(buf) - p);
 }
 
-void rpmRecordParser::BufCatDep(Dependency *Dep)
+static void BufCatDep(string &Out, const Dependency &Dep)
 {
-   BufCat(Dep->Name.c_str());
-   if (!Dep->Version.empty()) {
-      BufCat(" (");
-      switch (Dep->Op) {
+   Out += Dep.Name;
+   if (!Dep.Version.empty()) {
+      switch (Dep.Op) {
          case pkgCache::Dep::Less:
-            BufCat("<");
+            Out += " (< ";
             break;
          case pkgCache::Dep::LessEq:
-            BufCat("<=");
+            Out += " (<= ";
             break;
          case pkgCache::Dep::Equals:
-            BufCat("=");
+            Out += " (= ";
             break;
          case pkgCache::Dep::Greater:
-            BufCat(">");
+            Out += " (> ";
             break;
          case pkgCache::Dep::GreaterEq:
-            BufCat(">=");
+            Out += " (>= ";
+            break;
+         default:
+            Out += " ( ";
             break;
       }
-      BufCat(" ");
-      BufCat(Dep->Version.c_str());
-      BufCat(")");
+      Out += Dep.Version;
+      Out += ')';
    }
 }
 
-void rpmRecordParser::BufCatDescr(const char *descr)
+static void BufCatDescr(string &Out, std::string_view descr)
 {
-   const char *begin = descr;
-
-   while (*descr) {
-      if (*(descr++) == '\n') {
-	 BufCat(" ");
-	 BufCat(begin, descr);
-	 begin = descr;
+   const char *begin = descr.data();
+   const char *end = begin + descr.size();
+
+   for (const char *p = begin; p != end;) {
+      if (*(p++) == '\n') {
+	 Out += ' ';
+	 Out.append(begin, p - begin);
+	 begin = p;
       }
    }
-   if (*begin) {
-      BufCat(" ");
-      BufCat(begin, descr);
-      BufCat("\n");
+   if (begin != end) {
+      Out += ' ';
+      Out.append(begin, end - begin);
+      Out += '\n';
    }
 }
 
-void rpmRecordParser::BufCatDepList(unsigned int Type, unsigned int SubType,
+// RecordParser::BufCatDepList - Write the dependencies of one kind	/*{{{*/
+// ---------------------------------------------------------------------
+/* Deps holds those of the current record, as filled by PRCO. */
+void rpmRecordParser::BufCatDepList(string &Out, unsigned int SubType,
 				    const char *prefix)
 {
-   vector<Dependency*> Deps;
-   if (!Handler->PRCO(Type, Deps, false))
-      return;
-
    bool start = true;
-   for (vector<Dependency*>::const_iterator I = Deps.begin(); I != Deps.end(); ++I) {
-      if ((*I)->Type != SubType)
+   for (DepArena::const_iterator I = Deps.begin(); I != Deps.end(); ++I) {
+      if (I->Type != SubType)
 	 continue;
       if (start) {
-	 BufCat(prefix);
+	 Out += prefix;
 	 start = false;
       } else {
-	 BufCat(", ");
+	 Out += ", ";
       }
-      BufCatDep(*I);
-      delete (*I);
+      BufCatDep(Out, *I);
    }
 }
-
-// RecordParser::GetRec - The record in raw text, in std Debian format	/*{{{*/
+									/*}}}*/
+// RecordParser::AppendRec - The record in raw text, in std Debian format	/*{{{*/
 // ---------------------------------------------------------------------
-void rpmRecordParser::GetRec(const char *&Start,const char *&Stop)
+/* The record is written straight to the end of Out, whose storage is
+   reused by the callers keeping it across records. The dependencies are
+   read once per type into the arena kept by the parser, which also keeps
+   their strings from one record to the next. */
+void rpmRecordParser::AppendRec(string &Out)
 {
-   char buf[32];
-
-   BufUsed = 0;
-
-   BufCatTag("Package: ", Name().c_str());
+   BufCatTag(Out, "Package: ", Handler->NameView());
 
-   BufCatTag("\nSection: ", Handler->Group().c_str());
+   BufCatTag(Out, "\nSection: ", Handler->GroupView());
 
-   snprintf(buf, sizeof(buf), "%llu", (unsigned long long) Handler->InstalledSize());
-   BufCatTag("\nInstalled Size: ", buf);
+   BufCatNum(Out, "\nInstalled Size: ", Handler->InstalledSize());
 
-   BufCatTag("\nMaintainer: ", Handler->Packager().c_str());
+   BufCatTag(Out, "\nMaintainer: ", Handler->Packager());
 
-   BufCatTag("\nVersion: ", Handler->EVRDB().c_str());
+   BufCatTag(Out, "\nVersion: ", Handler->EVRDB());
 
-   struct {
+   static const struct {
       unsigned int Type, SubType;
       const char *prefix;
    } dep_types[] = {
@@ -269,32 +252,49 @@ void rpmRecordParser::GetRec(const char *&Start,const char *&Stop)
       { pkgCache::Dep::Obsoletes, pkgCache::Dep::Obsoletes, "\nObsoletes: " }
    };
 
-   for (size_t i = 0; i < sizeof(dep_types) / sizeof(*dep_types); ++i)
-      BufCatDepList(dep_types[i].Type, dep_types[i].SubType, dep_types[i].prefix);
+   unsigned int Loaded = ~0U;
+   bool Failed = false;
+   for (size_t i = 0; i < sizeof(dep_types) / sizeof(*dep_types); ++i) {
+      // Pre-Depends and Depends come from the same list
+      if (dep_types[i].Type != Loaded) {
+	 Loaded = dep_types[i].Type;
+	 Deps.Clear();
+	 Failed = !Handler->PRCO(Loaded, Deps, false);
+      }
+      if (!Failed)
+	 BufCatDepList(Out, dep_types[i].SubType, dep_types[i].prefix);
+   }
 
-   BufCatTag("\nArchitecture: ", Handler->Arch().c_str());
+   BufCatTag(Out, "\nArchitecture: ", Handler->ArchView());
 
-   snprintf(buf, sizeof(buf), "%llu", (unsigned long long) Handler->FileSize());
-   BufCatTag("\nSize: ", buf);
+   BufCatNum(Out, "\nSize: ", Handler->FileSize());
 
-   BufCatTag("\nMD5Sum: ", Handler->MD5Sum().c_str());
+   BufCatTag(Out, "\nMD5Sum: ", Handler->MD5Sum());
 
-   BufCatTag("\nFilename: ", Handler->FileName().c_str());
+   BufCatTag(Out, "\nFilename: ", Handler->FileName());
 
-   BufCatTag("\nDescription: ", Handler->Summary().c_str());
-   BufCat("\n");
-   BufCatDescr(Handler->Description().c_str());
+   BufCatTag(Out, "\nDescription: ", Handler->SummaryView());
+   Out += '\n';
+   BufCatDescr(Out, Handler->DescriptionView());
 
    string changelog = Handler->Changelog();
    if (!changelog.empty()) {
-      BufCat("Changelog:\n");
-      BufCatDescr(changelog.c_str());
+      Out += "Changelog:\n";
+      BufCatDescr(Out, changelog);
    }
 
-   BufCat("\n");
-
-   Start = Buffer;
-   Stop = Buffer + BufUsed;
+   Out += '\n';
+}
+									/*}}}*/
+// RecordParser::GetRec - The record in raw text, in std Debian format	/*{{{*/
+// ---------------------------------------------------------------------
+/* The text stays valid until the next record is formatted. */
+void rpmRecordParser::GetRec(const char *&Start,const char *&Stop)
+{
+   Buffer.clear();
+   AppendRec(Buffer);
+   Start = Buffer.data();
+   Stop = Buffer.data() + Buffer.size();
 }
 									/*}}}*/
 
@@ -25,17 +25,11 @@ class rpmRecordParser : public pkgRecords::Parser
    RPMHandler *Handler;
    bool IsDatabase;
 
-   char *Buffer;
-   unsigned BufSize;
-   unsigned BufUsed;
-
-   void BufCat(const char *text);
-   void BufCat(const char *begin, const char *end);
-   void BufCatTag(const char *tag, const char *value);
-   void BufCatDep(Dependency *Dep);
-   void BufCatDepList(unsigned int Type, unsigned int SubType,
-		      const char *prefix);
-   void BufCatDescr(const char *descr);
+   // Kept across records so that formatting them does not allocate
+   string Buffer;
+   DepArena Deps;
+
+   void BufCatDepList(string &Out, unsigned int SubType, const char *prefix);
 
    protected:
 
@@ -58,6 +52,7 @@ class rpmRecordParser : public pkgRecords::Parser
 
    // The record in raw text, in standard Debian format
    virtual void GetRec(const char *&Start,const char *&Stop) override;
+   virtual void AppendRec(string &Out) override;
 
    virtual bool HasFile(const char *File) override;
 
@@ -427,12 +427,22 @@ unsigned long rpmSystem::OptionsHash() const
    HashOptionTree(Hash, "RPM::MultiArch");
    HashOptionTree(Hash, "RPM::Ignore");
    HashOptionFile(Hash, "Dir::Etc::pkgpriorities");
+   if (_config->FindB("APT::Cache-Texts", false) == true)
+      HashString(Hash, "APT::Cache-Texts");
    HashEnv(Hash, "LANG");
    HashEnv(Hash, "LC_ALL");
    HashEnv(Hash, "LC_MESSAGES");
    return Hash;
 }
 									/*}}}*/
+// System::PruneCaches - Drop the caches of removed sources		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+bool rpmSystem::PruneCaches(pkgSourceList const &List)
+{
+   return rpmPruneDirCaches(List);
+}
+									/*}}}*/
 
 #endif /* HAVE_RPM */
 
@@ -49,6 +49,7 @@ class rpmSystem : public pkgSystem
    virtual void CacheBuilt() override;
 
    virtual unsigned long OptionsHash() const override;
+   virtual bool PruneCaches(pkgSourceList const &List) override;
 
    rpmSystem();
    virtual ~rpmSystem();
@@ -0,0 +1,438 @@
+// Description								/*{{{*/
+/* ######################################################################
+
+   SAT Solver - A small conflict driven clause learning solver
+
+   ##################################################################### */
+									/*}}}*/
+// Include Files							/*{{{*/
+#include <config.h>
+
+#include <apt-pkg/satsolver.h>
+
+#include <algorithm>
+
+#include <sys/time.h>
+									/*}}}*/
+
+static const unsigned int NoPos = ~0U;
+
+// Luby - The restart sequence 1 1 2 1 1 2 4 1 1 2 ...			/*{{{*/
+static unsigned long Luby(unsigned long X)
+{
+   unsigned long Size = 1;
+   unsigned int Seq = 0;
+   while (Size < X + 1)
+   {
+      Seq++;
+      Size = 2*Size + 1;
+   }
+   while (Size - 1 != X)
+   {
+      Size = (Size - 1) >> 1;
+      Seq--;
+      X = X % Size;
+   }
+   return 1UL << Seq;
+}
+									/*}}}*/
+
+pkgSatSolver::pkgSatSolver() : QHead(0), Inconsistent(false), VarInc(1),
+			       Decisions(0), Conflicts(0), Propagations(0),
+			       Learnt(0), Restarts(0)
+{
+}
+
+// SatSolver::NewVar - Add a variable					/*{{{*/
+// ---------------------------------------------------------------------
+/* Phase is the value tried first and Activity orders the first
+   decisions, before any conflict was seen. */
+pkgSatSolver::Var pkgSatSolver::NewVar(bool Phase,double Activity)
+{
+   Var V = Values.size();
+   Values.push_back(0);
+   this->Phase.push_back(Phase);
+   Fallback.push_back(NoVar);
+   Level.push_back(0);
+   Reason.push_back(NoClause);
+   this->Activity.push_back(Activity);
+   Seen.push_back(false);
+   Watches.resize(Watches.size() + 2);
+   HeapPos.push_back(NoPos);
+   HeapInsert(V);
+   return V;
+}
+									/*}}}*/
+// SatSolver::AddClause - Add a clause to the problem			/*{{{*/
+// ---------------------------------------------------------------------
+/* Literals already false are dropped and a clause already true is not
+   kept at all. A clause left with one literal is assigned at once. */
+bool pkgSatSolver::AddClause(std::vector<Lit> Lits)
+{
+   if (Inconsistent == true)
+      return false;
+   Backtrack(0);
+
+   std::sort(Lits.begin(),Lits.end());
+   Lits.erase(std::unique(Lits.begin(),Lits.end()),Lits.end());
+   unsigned int J = 0;
+   for (unsigned int I = 0; I != Lits.size(); I++)
+   {
+      if (LitValue(Lits[I]) > 0 ||
+	  (I + 1 != Lits.size() && Lits[I + 1] == (Lits[I] ^ 1)))
+	 return true;
+      if (LitValue(Lits[I]) == 0)
+	 Lits[J++] = Lits[I];
+   }
+   Lits.resize(J);
+
+   if (Lits.empty() == true)
+   {
+      Inconsistent = true;
+      return false;
+   }
+   if (Lits.size() == 1)
+   {
+      Enqueue(Lits[0],NoClause);
+      return true;
+   }
+
+   Clause C = {Lits,false};
+   Watches[Lits[0]].push_back(Clauses.size());
+   Watches[Lits[1]].push_back(Clauses.size());
+   Clauses.push_back(std::move(C));
+   return true;
+}
+									/*}}}*/
+// SatSolver::Heap* - Binary heap of variables by activity		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgSatSolver::HeapUp(unsigned int I)
+{
+   Var V = Heap[I];
+   while (I != 0)
+   {
+      unsigned int Parent = (I - 1) >> 1;
+      if (Activity[Heap[Parent]] >= Activity[V])
+	 break;
+      Heap[I] = Heap[Parent];
+      HeapPos[Heap[I]] = I;
+      I = Parent;
+   }
+   Heap[I] = V;
+   HeapPos[V] = I;
+}
+void pkgSatSolver::HeapDown(unsigned int I)
+{
+   Var V = Heap[I];
+   while (true)
+   {
+      unsigned int Child = 2*I + 1;
+      if (Child >= Heap.size())
+	 break;
+      if (Child + 1 < Heap.size() &&
+	  Activity[Heap[Child + 1]] > Activity[Heap[Child]])
+	 Child++;
+      if (Activity[Heap[Child]] <= Activity[V])
+	 break;
+      Heap[I] = Heap[Child];
+      HeapPos[Heap[I]] = I;
+      I = Child;
+   }
+   Heap[I] = V;
+   HeapPos[V] = I;
+}
+void pkgSatSolver::HeapInsert(Var V)
+{
+   if (HeapPos[V] != NoPos)
+      return;
+   Heap.push_back(V);
+   HeapUp(Heap.size() - 1);
+}
+pkgSatSolver::Var pkgSatSolver::HeapPop()
+{
+   Var V = Heap[0];
+   HeapPos[V] = NoPos;
+   Heap[0] = Heap.back();
+   Heap.pop_back();
+   if (Heap.empty() == false)
+   {
+      HeapPos[Heap[0]] = 0;
+      HeapDown(0);
+   }
+   return V;
+}
+									/*}}}*/
+// SatSolver::Bump - Raise the activity of a variable in a conflict	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgSatSolver::Bump(Var V)
+{
+   if ((Activity[V] += VarInc) > 1e100)
+   {
+      for (unsigned int I = 0; I != Activity.size(); I++)
+	 Activity[I] *= 1e-100;
+      VarInc *= 1e-100;
+   }
+   if (HeapPos[V] != NoPos)
+      HeapUp(HeapPos[V]);
+}
+									/*}}}*/
+// SatSolver::Enqueue - Assign a literal true				/*{{{*/
+// ---------------------------------------------------------------------
+/* From is the clause which implied it, or NoClause for a decision. */
+void pkgSatSolver::Enqueue(Lit L,unsigned int From)
+{
+   Var V = L >> 1;
+   Values[V] = (L & 1) ? -1 : 1;
+   Level[V] = DecisionLevel();
+   Reason[V] = From;
+   Trail.push_back(L);
+}
+									/*}}}*/
+// SatSolver::Propagate - Assign everything implied by the trail	/*{{{*/
+// ---------------------------------------------------------------------
+/* The two first literals of a clause are the watched ones. Returns the
+   clause found false, or NoClause. */
+unsigned int pkgSatSolver::Propagate()
+{
+   while (QHead < Trail.size())
+   {
+      Lit False = Trail[QHead++] ^ 1;
+      std::vector<unsigned int> &Watch = Watches[False];
+      Propagations++;
+
+      unsigned int I = 0;
+      unsigned int J = 0;
+      while (I != Watch.size())
+      {
+	 unsigned int CI = Watch[I++];
+	 std::vector<Lit> &C = Clauses[CI].Lits;
+	 if (C[0] == False)
+	    std::swap(C[0],C[1]);
+	 if (LitValue(C[0]) > 0)
+	 {
+	    Watch[J++] = CI;
+	    continue;
+	 }
+
+	 // Look for another literal to watch
+	 bool Moved = false;
+	 for (unsigned int K = 2; K != C.size(); K++)
+	 {
+	    if (LitValue(C[K]) >= 0)
+	    {
+	       std::swap(C[1],C[K]);
+	       Watches[C[1]].push_back(CI);
+	       Moved = true;
+	       break;
+	    }
+	 }
+	 if (Moved == true)
+	    continue;
+
+	 Watch[J++] = CI;
+	 if (LitValue(C[0]) < 0)
+	 {
+	    while (I != Watch.size())
+	       Watch[J++] = Watch[I++];
+	    Watch.resize(J);
+	    return CI;
+	 }
+	 Enqueue(C[0],CI);
+      }
+      Watch.resize(J);
+   }
+   return NoClause;
+}
+									/*}}}*/
+// SatSolver::Analyze - Learn a clause from a conflict			/*{{{*/
+// ---------------------------------------------------------------------
+/* The reasons of the conflict are resolved back along the trail until a
+   single literal of the current level is left, the first unique
+   implication point. Its negation comes first in Out and BtLevel is the
+   level at which Out becomes unit. */
+void pkgSatSolver::Analyze(unsigned int Confl,std::vector<Lit> &Out,
+			   unsigned int &BtLevel)
+{
+   Out.assign(1,0);
+   unsigned int Paths = 0;
+   unsigned int Index = Trail.size();
+   Lit P = 0;
+   bool First = true;
+   do
+   {
+      const std::vector<Lit> &C = Clauses[Confl].Lits;
+      for (unsigned int K = First ? 0 : 1; K != C.size(); K++)
+      {
+	 Var V = C[K] >> 1;
+	 if (Seen[V] == true || Level[V] == 0)
+	    continue;
+	 Seen[V] = true;
+	 Bump(V);
+	 if (Level[V] >= DecisionLevel())
+	    Paths++;
+	 else
+	    Out.push_back(C[K]);
+      }
+      First = false;
+
+      // The next literal of the trail which is part of the conflict
+      while (Seen[Trail[--Index] >> 1] == false);
+      P = Trail[Index];
+      Confl = Reason[P >> 1];
+      Seen[P >> 1] = false;
+      Paths--;
+   }
+   while (Paths != 0);
+   Out[0] = P ^ 1;
+
+   BtLevel = 0;
+   unsigned int Max = 1;
+   for (unsigned int K = 1; K != Out.size(); K++)
+   {
+      Seen[Out[K] >> 1] = false;
+      if (Level[Out[K] >> 1] > BtLevel)
+      {
+	 BtLevel = Level[Out[K] >> 1];
+	 Max = K;
+      }
+   }
+   if (Out.size() > 1)
+      std::swap(Out[1],Out[Max]);
+}
+									/*}}}*/
+// SatSolver::Backtrack - Undo the assignment above a level		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgSatSolver::Backtrack(unsigned int ToLevel)
+{
+   if (DecisionLevel() <= ToLevel)
+      return;
+   for (unsigned int I = Trail.size(); I != TrailLim[ToLevel]; I--)
+   {
+      Var V = Trail[I - 1] >> 1;
+      Phase[V] = Values[V] > 0;
+      Values[V] = 0;
+      Reason[V] = NoClause;
+      HeapInsert(V);
+   }
+   Trail.resize(TrailLim[ToLevel]);
+   TrailLim.resize(ToLevel);
+   QHead = Trail.size();
+}
+									/*}}}*/
+// SatSolver::PickBranch - Choose the next decision			/*{{{*/
+// ---------------------------------------------------------------------
+/* The most active unassigned variable, or the alternative it falls back
+   to while that one is still open. */
+pkgSatSolver::Var pkgSatSolver::PickBranch()
+{
+   Var V = NoVar;
+   while (Heap.empty() == false)
+   {
+      V = HeapPop();
+      if (Values[V] == 0)
+	 break;
+      V = NoVar;
+   }
+   if (V == NoVar)
+      return NoVar;
+
+   Var Pick = V;
+   while (Fallback[Pick] != NoVar && Values[Fallback[Pick]] == 0)
+      Pick = Fallback[Pick];
+   if (Pick != V)
+      HeapInsert(V);
+   return Pick;
+}
+									/*}}}*/
+// SatSolver::Solve - Search for an assignment				/*{{{*/
+// ---------------------------------------------------------------------
+/* On Sat the assignment is kept for Value(). The clock is only looked
+   at every 64 conflicts. */
+pkgSatSolver::Result pkgSatSolver::Solve(unsigned long MaxConflicts,
+					 double MaxSeconds)
+{
+   if (Inconsistent == true)
+      return Unsat;
+   Backtrack(0);
+
+   struct timeval Begin;
+   gettimeofday(&Begin,0);
+
+   const unsigned long Start = Conflicts;
+   unsigned long Restart = 0;
+   unsigned long Limit = 100*Luby(Restart);
+   unsigned long Since = 0;
+   std::vector<Lit> Out;
+   while (true)
+   {
+      unsigned int Confl = Propagate();
+      if (Confl != NoClause)
+      {
+	 Conflicts++;
+	 Since++;
+	 if (DecisionLevel() == 0)
+	 {
+	    Inconsistent = true;
+	    return Unsat;
+	 }
+
+	 unsigned int BtLevel;
+	 Analyze(Confl,Out,BtLevel);
+	 Backtrack(BtLevel);
+	 if (Out.size() == 1)
+	    Enqueue(Out[0],NoClause);
+	 else
+	 {
+	    Clause C = {Out,true};
+	    Watches[Out[0]].push_back(Clauses.size());
+	    Watches[Out[1]].push_back(Clauses.size());
+	    Clauses.push_back(std::move(C));
+	    Enqueue(Out[0],Clauses.size() - 1);
+	 }
+	 Learnt++;
+	 VarInc /= 0.95;
+
+	 if (MaxConflicts != 0 && Conflicts - Start >= MaxConflicts)
+	 {
+	    Backtrack(0);
+	    return Unknown;
+	 }
+	 if (MaxSeconds != 0 && (Conflicts - Start) % 64 == 0)
+	 {
+	    struct timeval Now;
+	    gettimeofday(&Now,0);
+	    if (Now.tv_sec - Begin.tv_sec +
+		(Now.tv_usec - Begin.tv_usec)/1000000.0 >= MaxSeconds)
+	    {
+	       Backtrack(0);
+	       return Unknown;
+	    }
+	 }
+	 continue;
+      }
+
+      if (Since >= Limit)
+      {
+	 Restarts++;
+	 Since = 0;
+	 Limit = 100*Luby(++Restart);
+	 Backtrack(0);
+	 continue;
+      }
+
+      Var V = PickBranch();
+      if (V == NoVar)
+	 return Sat;
+
+      bool Value = Phase[V];
+      if (Fallback[V] != NoVar && Values[Fallback[V]] < 0)
+	 Value = true;
+      Decisions++;
+      TrailLim.push_back(Trail.size());
+      Enqueue(Value == true ? Pos(V) : Neg(V),NoClause);
+   }
+}
+									/*}}}*/
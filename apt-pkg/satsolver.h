@@ -0,0 +1,111 @@
+// Description								/*{{{*/
+/* ######################################################################
+
+   SAT Solver - A small conflict driven clause learning solver
+
+   This is the engine behind the "sat" problem resolver. Variables are
+   numbered from 0 and literals are Var*2, plus 1 for the negation.
+   Propagation uses two watched literals per clause, conflicts are
+   analysed to the first unique implication point and learnt, branching
+   follows the activity of the variables with restarts on the Luby
+   sequence, and every variable remembers the value it had last.
+
+   A variable may fall back to another one it is an alternative to, it is
+   then only branched on once the other one is assigned and is set true
+   when the other one was set false. The resolver uses this to prefer
+   keeping a package over removing it.
+
+   ##################################################################### */
+									/*}}}*/
+#ifndef PKGLIB_SATSOLVER_H
+#define PKGLIB_SATSOLVER_H
+
+#include <vector>
+
+class pkgSatSolver
+{
+   public:
+
+   typedef unsigned int Var;
+   typedef unsigned int Lit;
+   static constexpr Var NoVar = ~0U;
+
+   enum Result {Sat, Unsat, Unknown};
+
+   static inline Lit Pos(Var V) {return V*2;}
+   static inline Lit Neg(Var V) {return V*2 + 1;}
+
+   protected:
+
+   static constexpr unsigned int NoClause = ~0U;
+
+   struct Clause
+   {
+      std::vector<Lit> Lits;
+      bool Learnt;
+   };
+   std::vector<Clause> Clauses;
+   std::vector<std::vector<unsigned int> > Watches;
+
+   // Per variable
+   std::vector<signed char> Values;
+   std::vector<bool> Phase;
+   std::vector<Var> Fallback;
+   std::vector<unsigned int> Level;
+   std::vector<unsigned int> Reason;
+   std::vector<double> Activity;
+   std::vector<bool> Seen;
+
+   // The assignment in the order it was made
+   std::vector<Lit> Trail;
+   std::vector<unsigned int> TrailLim;
+   unsigned int QHead;
+   bool Inconsistent;
+   double VarInc;
+
+   // Unassigned variables by activity
+   std::vector<Var> Heap;
+   std::vector<unsigned int> HeapPos;
+   void HeapUp(unsigned int I);
+   void HeapDown(unsigned int I);
+   void HeapInsert(Var V);
+   Var HeapPop();
+
+   inline signed char LitValue(Lit L) const
+      {return (L & 1) ? -Values[L >> 1] : Values[L >> 1];}
+   inline unsigned int DecisionLevel() const {return TrailLim.size();}
+
+   void Enqueue(Lit L,unsigned int From);
+   unsigned int Propagate();
+   void Analyze(unsigned int Confl,std::vector<Lit> &Out,unsigned int &BtLevel);
+   void Backtrack(unsigned int ToLevel);
+   void Bump(Var V);
+   Var PickBranch();
+
+   public:
+
+   // Statistics of all the Solve calls
+   unsigned long Decisions;
+   unsigned long Conflicts;
+   unsigned long Propagations;
+   unsigned long Learnt;
+   unsigned long Restarts;
+
+   Var NewVar(bool Phase = false,double Activity = 0);
+   void SetFallback(Var V,Var Preferred) {Fallback[V] = Preferred;}
+
+   // False once the clauses are known to be unsatisfiable
+   bool AddClause(std::vector<Lit> Lits);
+
+   /* Unknown once MaxConflicts conflicts were met or MaxSeconds went by,
+      0 not limiting the search */
+   Result Solve(unsigned long MaxConflicts = 0,double MaxSeconds = 0);
+   inline bool Value(Var V) const {return Values[V] > 0;}
+
+   inline unsigned long VarCount() const {return Values.size();}
+   inline unsigned long ClauseCount() const {return Clauses.size();}
+
+   pkgSatSolver();
+};
+
+#endif
@@ -0,0 +1,388 @@
+// Description								/*{{{*/
+/* ######################################################################
+
+   Search Index - Words of the package summaries and descriptions
+
+   The file holds a header, the table of words sorted by their text, the
+   table of the suffixes of every word sorted by their text, the text of
+   the words and then the sorted version IDs of each word, all in the
+   native byte order since it is never used on another host. A pattern
+   found inside a word begins one of its suffixes, so the words holding it
+   are those of a single range of the suffix table.
+
+   ##################################################################### */
+									/*}}}*/
+// Include Files							/*{{{*/
+#include <config.h>
+
+#include <apt-pkg/searchindex.h>
+#include <apt-pkg/pkgrecords.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/mmap.h>
+#include <apt-pkg/error.h>
+
+#include <algorithm>
+#include <map>
+#include <string_view>
+#include <cstring>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+									/*}}}*/
+
+static const char IndexMagic[8] = {'A','P','T','S','I','D','X','2'};
+
+struct IndexHeader
+{
+   char Magic[8];
+   uint64_t Fingerprint;
+   uint32_t WordCount;
+   uint32_t SuffixCount;
+   uint32_t TextSize;
+   uint32_t PostingCount;
+};
+
+struct pkgSearchIndex::Word
+{
+   uint32_t Text;
+   uint32_t Length;
+   uint32_t Postings;
+   uint32_t Count;
+};
+
+struct pkgSearchIndex::Suffix
+{
+   uint32_t Word;
+   uint32_t Offset;
+};
+
+// Letters, digits and anything beyond ASCII make up words, in lower case
+static inline bool IsWordChar(unsigned char C)
+{
+   return (C >= 'a' && C <= 'z') || (C >= 'A' && C <= 'Z') ||
+          (C >= '0' && C <= '9') || C >= 0x80;
+}
+
+static inline char Lower(char C)
+{
+   return (C >= 'A' && C <= 'Z') ? C - 'A' + 'a' : C;
+}
+
+static void AddWords(std::map<std::string,std::vector<uint32_t> > &Index,
+		     const std::string &Text,uint32_t ID)
+{
+   std::string Word;
+   for (std::string::const_iterator I = Text.begin(); ; ++I)
+   {
+      if (I != Text.end() && IsWordChar(*I) == true)
+      {
+	 Word += Lower(*I);
+	 continue;
+      }
+      if (Word.empty() == false)
+      {
+	 std::vector<uint32_t> &IDs = Index[Word];
+	 if (IDs.empty() == true || IDs.back() != ID)
+	    IDs.push_back(ID);
+	 Word.clear();
+      }
+      if (I == Text.end())
+	 break;
+   }
+}
+
+pkgSearchIndex::pkgSearchIndex() : Words(0), WordCount(0), Suffixes(0),
+				   SuffixCount(0), Text(0), Postings(0)
+{
+}
+
+pkgSearchIndex::~pkgSearchIndex()
+{
+}
+
+// SearchIndex::Fingerprint - Identify the versions of a cache		/*{{{*/
+// ---------------------------------------------------------------------
+/* Two caches with the same fingerprint have the same versions under the
+   same IDs. Caches read from the same unchanged files may still differ
+   with the way they were built, so the cache file is identified as well;
+   only a cache which is not kept has its versions walked instead. */
+uint64_t pkgSearchIndex::Fingerprint(pkgCache &Cache)
+{
+   uint64_t Hash = 14695981039346656037ULL;
+   auto Add = [&Hash](const void *Data,size_t Size) {
+      const unsigned char *P = (const unsigned char *)Data;
+      for (size_t I = 0; I != Size; I++)
+	 Hash = (Hash ^ P[I]) * 1099511628211ULL;
+   };
+
+   Add(&Cache.HeaderP->VersionCount,sizeof(Cache.HeaderP->VersionCount));
+   Add(&Cache.HeaderP->PackageCount,sizeof(Cache.HeaderP->PackageCount));
+   Add(&Cache.HeaderP->OptionsHash,sizeof(Cache.HeaderP->OptionsHash));
+   for (pkgCache::PkgFileIterator F = Cache.FileBegin(); F.end() == false; F++)
+   {
+      Add(F.FileName(),strlen(F.FileName()) + 1);
+      Add(&F->Size,sizeof(F->Size));
+      Add(&F->mtime,sizeof(F->mtime));
+   }
+
+   const std::string CacheFile = _config->FindFile("Dir::Cache::pkgcache");
+   struct stat St;
+   if (CacheFile.empty() == false && stat(CacheFile.c_str(),&St) == 0)
+   {
+      Add(&St.st_dev,sizeof(St.st_dev));
+      Add(&St.st_ino,sizeof(St.st_ino));
+      Add(&St.st_size,sizeof(St.st_size));
+      Add(&St.st_mtim.tv_sec,sizeof(St.st_mtim.tv_sec));
+      Add(&St.st_mtim.tv_nsec,sizeof(St.st_mtim.tv_nsec));
+      return Hash;
+   }
+
+   for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; P++)
+      for (pkgCache::VerIterator V = P.VersionList(); V.end() == false; V++)
+      {
+	 Add(&V->ID,sizeof(V->ID));
+	 for (pkgCache::VerFileIterator VF = V.FileList(); VF.end() == false; VF++)
+	 {
+	    Add(&VF->File,sizeof(VF->File));
+	    Add(&VF->Offset,sizeof(VF->Offset));
+	 }
+      }
+   return Hash;
+}
+									/*}}}*/
+// SearchIndex::Load - Map the index kept in File			/*{{{*/
+// ---------------------------------------------------------------------
+/* Fails quietly unless File holds a sound index with the fingerprint
+   Print. */
+bool pkgSearchIndex::Load(const std::string &File,uint64_t Print)
+{
+   struct stat St;
+   if (stat(File.c_str(),&St) != 0 || St.st_size < (off_t)sizeof(IndexHeader))
+      return false;
+
+   FileFd Fd(File,FileFd::ReadOnly);
+   if (_error->PendingError() == true)
+      return false;
+   std::unique_ptr<MMap> NewMap(new MMap(Fd,MMap::Public | MMap::ReadOnly));
+   if (_error->PendingError() == true)
+      return false;
+
+   const char *Base = (const char *)NewMap->Data();
+   const size_t Size = NewMap->Size();
+   IndexHeader Head;
+   memcpy(&Head,Base,sizeof(Head));
+   if (memcmp(Head.Magic,IndexMagic,sizeof(IndexMagic)) != 0 ||
+       Head.Fingerprint != Print)
+      return false;
+
+   const size_t SuffixStart = sizeof(Head) + (size_t)Head.WordCount*sizeof(Word);
+   const size_t TextStart = SuffixStart + (size_t)Head.SuffixCount*sizeof(Suffix);
+   const size_t PostStart = TextStart + ((Head.TextSize + 3) & ~3U);
+   if (PostStart + (size_t)Head.PostingCount*sizeof(uint32_t) != Size)
+      return false;
+
+   const Word *NewWords = (const Word *)(Base + sizeof(Head));
+   for (uint32_t I = 0; I != Head.WordCount; I++)
+      if (NewWords[I].Text > Head.TextSize ||
+	  NewWords[I].Length > Head.TextSize - NewWords[I].Text ||
+	  NewWords[I].Postings > Head.PostingCount ||
+	  NewWords[I].Count > Head.PostingCount - NewWords[I].Postings)
+	 return false;
+   const Suffix *NewSuffixes = (const Suffix *)(Base + SuffixStart);
+   for (uint32_t I = 0; I != Head.SuffixCount; I++)
+      if (NewSuffixes[I].Word >= Head.WordCount ||
+	  NewSuffixes[I].Offset >= NewWords[NewSuffixes[I].Word].Length)
+	 return false;
+
+   Map = std::move(NewMap);
+   Words = NewWords;
+   WordCount = Head.WordCount;
+   Suffixes = NewSuffixes;
+   SuffixCount = Head.SuffixCount;
+   Text = Base + TextStart;
+   Postings = (const uint32_t *)(Base + PostStart);
+   return true;
+}
+									/*}}}*/
+// SearchIndex::Build - Index every version of the cache		/*{{{*/
+// ---------------------------------------------------------------------
+/* The index is written aside and renamed over File once complete. Every
+   version is indexed, not only the candidates, so that the index still
+   holds after the pins changed. Failing to write it is not an error, the
+   searches then only read all the records. */
+bool pkgSearchIndex::Build(pkgCache &Cache,const std::string &File,
+			   uint64_t Print)
+{
+   pkgRecords Recs(Cache);
+   if (_error->PendingError() == true)
+      return false;
+
+   std::map<std::string,std::vector<uint32_t> > Index;
+   std::vector<std::pair<pkgCache::VerFile *,uint32_t> > Records;
+   for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; P++)
+      for (pkgCache::VerIterator V = P.VersionList(); V.end() == false; V++)
+      {
+	 if (V.Summary() != 0 && V.Description() != 0)
+	 {
+	    AddWords(Index,V.Summary(),V->ID);
+	    AddWords(Index,V.Description(),V->ID);
+	    continue;
+	 }
+	 if (V.FileList().end() == true)
+	    continue;
+	 Records.push_back(std::make_pair((pkgCache::VerFile *)V.FileList(),
+					  (uint32_t)V->ID));
+      }
+
+   // The records are read in the order of their files, as search does
+   std::sort(Records.begin(),Records.end(),
+	     [](const std::pair<pkgCache::VerFile *,uint32_t> &A,
+		const std::pair<pkgCache::VerFile *,uint32_t> &B) {
+		if (A.first->File != B.first->File)
+		   return A.first->File < B.first->File;
+		return A.first->Offset < B.first->Offset;
+	     });
+   for (auto I = Records.begin(); I != Records.end() &&
+	_error->PendingError() == false; ++I)
+   {
+      pkgRecords::Parser &Parse = Recs.Lookup(pkgCache::VerFileIterator(Cache,I->first));
+      AddWords(Index,Parse.ShortDesc(),I->second);
+      AddWords(Index,Parse.LongDesc(),I->second);
+   }
+   if (_error->PendingError() == true)
+      return false;
+
+   IndexHeader Head;
+   memset(&Head,0,sizeof(Head));
+   memcpy(Head.Magic,IndexMagic,sizeof(IndexMagic));
+   Head.Fingerprint = Print;
+   Head.WordCount = Index.size();
+
+   std::vector<Word> Table;
+   std::vector<Suffix> SuffixTable;
+   std::string Texts;
+   std::vector<uint32_t> IDs;
+   Table.reserve(Index.size());
+   for (auto I = Index.begin(); I != Index.end(); ++I)
+   {
+      std::vector<uint32_t> &Vers = I->second;
+      std::sort(Vers.begin(),Vers.end());
+      Vers.erase(std::unique(Vers.begin(),Vers.end()),Vers.end());
+
+      Word W = {(uint32_t)Texts.size(),(uint32_t)I->first.size(),
+		(uint32_t)IDs.size(),(uint32_t)Vers.size()};
+      for (uint32_t O = 0; O != W.Length; O++)
+	 SuffixTable.push_back({(uint32_t)Table.size(),O});
+      Table.push_back(W);
+      Texts += I->first;
+      IDs.insert(IDs.end(),Vers.begin(),Vers.end());
+   }
+   auto View = [&Table,&Texts](const Suffix &S) {
+      return std::string_view(Texts.data() + Table[S.Word].Text + S.Offset,
+			      Table[S.Word].Length - S.Offset);
+   };
+   std::sort(SuffixTable.begin(),SuffixTable.end(),
+	     [&View](const Suffix &A,const Suffix &B) {
+		int Res = View(A).compare(View(B));
+		return Res < 0 || (Res == 0 && A.Word < B.Word);
+	     });
+   Head.SuffixCount = SuffixTable.size();
+   Head.TextSize = Texts.size();
+   Head.PostingCount = IDs.size();
+   Texts.resize((Texts.size() + 3) & ~(size_t)3,'\0');
+
+   std::string Tmp = File + ".XXXXXX";
+   int Fd = mkstemp(&Tmp[0]);
+   if (Fd < 0)
+      return true;
+   fchmod(Fd,0644);
+   FileFd Out(Fd);
+   bool Res = Out.Write(&Head,sizeof(Head)) &&
+	      Out.Write(Table.data(),Table.size()*sizeof(Word)) &&
+	      Out.Write(SuffixTable.data(),SuffixTable.size()*sizeof(Suffix)) &&
+	      Out.Write(Texts.data(),Texts.size()) &&
+	      Out.Write(IDs.data(),IDs.size()*sizeof(uint32_t)) &&
+	      Out.Close();
+   if (Res == false || rename(Tmp.c_str(),File.c_str()) != 0)
+   {
+      unlink(Tmp.c_str());
+      _error->Discard();
+   }
+   return true;
+}
+									/*}}}*/
+// SearchIndex::Generate - Keep the index of this cache current		/*{{{*/
+// ---------------------------------------------------------------------
+/* Run along with the cache generation, since building the index reads
+   every record and costs more than a search without it. */
+bool pkgSearchIndex::Generate(pkgCache &Cache)
+{
+   if (_config->Find("Dir::Cache::searchindex").empty() == true)
+      return true;
+   const std::string File = _config->FindFile("Dir::Cache::searchindex");
+   if (access(flNotFile(File).c_str(),W_OK) != 0)
+      return true;
+   const uint64_t Print = Fingerprint(Cache);
+   pkgSearchIndex Index;
+   if (Index.Load(File,Print) == true)
+      return true;
+   return Build(Cache,File,Print);
+}
+									/*}}}*/
+// SearchIndex::Open - Use the index of this cache			/*{{{*/
+// ---------------------------------------------------------------------
+/* False if there is no index to use. */
+bool pkgSearchIndex::Open(pkgCache &Cache)
+{
+   if (_config->Find("Dir::Cache::searchindex").empty() == true)
+      return false;
+   return Load(_config->FindFile("Dir::Cache::searchindex"),
+	       Fingerprint(Cache));
+}
+									/*}}}*/
+// SearchIndex::Usable - Check a pattern can be looked up		/*{{{*/
+// ---------------------------------------------------------------------
+/* A pattern of only letters and digits can only match within a single
+   word, so the words holding it give every record it may match. */
+bool pkgSearchIndex::Usable(const char *Pattern)
+{
+   if (*Pattern == 0)
+      return false;
+   for (; *Pattern != 0; Pattern++)
+      if (IsWordChar(*Pattern) == false || (unsigned char)*Pattern >= 0x80)
+	 return false;
+   return true;
+}
+									/*}}}*/
+// SearchIndex::Find - Mark the versions which may match		/*{{{*/
+// ---------------------------------------------------------------------
+/* The suffixes beginning with the pattern are found by a binary search,
+   and the words they belong to hold it. */
+void pkgSearchIndex::Find(const char *Pattern,std::vector<bool> &Vers) const
+{
+   std::string Needle;
+   for (; *Pattern != 0; Pattern++)
+      Needle += Lower(*Pattern);
+   const std::string_view Key(Needle);
+
+   auto View = [this](const Suffix &S) {
+      return std::string_view(Text + Words[S.Word].Text + S.Offset,
+			      Words[S.Word].Length - S.Offset);
+   };
+   const Suffix *End = Suffixes + SuffixCount;
+   const Suffix *I = std::lower_bound(Suffixes,End,Key,
+				      [&View](const Suffix &S,std::string_view K) {
+					 return View(S) < K;
+				      });
+   for (; I != End && View(*I).substr(0,Key.size()) == Key; ++I)
+   {
+      const Word &W = Words[I->Word];
+      const uint32_t *P = Postings + W.Postings;
+      for (uint32_t J = 0; J != W.Count; J++)
+	 if (P[J] < Vers.size())
+	    Vers[P[J]] = true;
+   }
+}
+									/*}}}*/
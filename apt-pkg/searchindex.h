@@ -0,0 +1,69 @@
+// Description								/*{{{*/
+/* ######################################################################
+
+   Search Index - Words of the package summaries and descriptions
+
+   An inverted index from the words found in the summary and description
+   of every version in the cache to the IDs of those versions, kept in
+   Dir::Cache::searchindex. A search for a plain word can then read the
+   records of the versions that may match it instead of those of every
+   package.
+
+   The index is only kept when Dir::Cache::searchindex is set, since it
+   costs a read of every record, and is then built along with the cache
+   by apt-get update and apt-cache gencaches. It is tied to the cache it was built for by a
+   fingerprint of the cache file and of the files it was built from, and
+   is not used once they differ.
+
+   ##################################################################### */
+									/*}}}*/
+#ifndef PKGLIB_SEARCHINDEX_H
+#define PKGLIB_SEARCHINDEX_H
+
+#include <apt-pkg/pkgcache.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class pkgRecords;
+class MMap;
+
+class pkgSearchIndex
+{
+   struct Word;
+   struct Suffix;
+
+   std::unique_ptr<MMap> Map;
+   const Word *Words;
+   uint32_t WordCount;
+   const Suffix *Suffixes;
+   uint32_t SuffixCount;
+   const char *Text;
+   const uint32_t *Postings;
+
+   static uint64_t Fingerprint(pkgCache &Cache);
+   bool Load(const std::string &File,uint64_t Print);
+   static bool Build(pkgCache &Cache,const std::string &File,uint64_t Print);
+
+   public:
+
+   // Whether the index can tell which records may match Pattern
+   static bool Usable(const char *Pattern);
+
+   // Builds the index of Cache unless it is current or cannot be written
+   static bool Generate(pkgCache &Cache);
+
+   // Opens the index of Cache, false if there is none or it is stale
+   bool Open(pkgCache &Cache);
+
+   /* Marks in Vers, by version ID, every version whose summary or
+      description may match the Usable() Pattern */
+   void Find(const char *Pattern,std::vector<bool> &Vers) const;
+
+   pkgSearchIndex();
+   ~pkgSearchIndex();
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/fileutl.h>
+#include <apt-pkg/pkgsystem.h>
 #include <apt-pkg/sourcelist.h>
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/update.h>
@@ -161,6 +162,14 @@ bool ListUpdate(pkgAcquireStatus &Stat,
          // something went wrong with the clean
          return false;
       }
+
+      // The decoded lists are named after the lists they were decoded from
+      string Parsed = _config->FindDir("Dir::Cache::parsed");
+      if (_config->Find("Dir::Cache::parsed").empty() == false &&
+          DirectoryExists(Parsed) == true && !Fetcher.Clean(Parsed))
+         return false;
+      if (!_system->PruneCaches(List))
+         return false;
    }
 
    if (errorsWereReported)
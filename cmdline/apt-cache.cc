@@ -22,6 +22,7 @@
 #include <apt-pkg/cmndline.h>
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/pkgrecords.h>
+#include <apt-pkg/searchindex.h>
 #include <apt-pkg/srcrecords.h>
 #include <apt-pkg/version.h>
 #include <apt-pkg/policy.h>
@@ -34,7 +35,11 @@
 // CNC:2003-02-14 - apti18n.h includes libintl.h which includes locale.h,
 //		    as reported by Radu Greab.
 //#include <locale.h>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <unistd.h>
 #include <errno.h>
 #include <regex.h>
@@ -297,6 +302,27 @@ bool Stats(CommandLine &Cmd)
    cout << _("  Mixed Virtual Packages: ") << NVirt << endl;
    cout << _("  Missing: ") << Missing << endl;
 
+   // How long FindPackage() has to walk, the last slot counts the rest
+   unsigned long const Buckets = Cache.Head().HashTableSize;
+   unsigned int const ChainSlots = 8;
+   unsigned long Chains[ChainSlots] = {};
+   unsigned long Longest = 0;
+   for (unsigned long I = 0; I != Buckets; I++)
+   {
+      unsigned long Length = 0;
+      for (map_ptrloc P = Cache.HashTableP[I]; P != 0; P = Cache.PkgP[P].NextPackage)
+	 Length++;
+      Chains[std::min<unsigned long>(Length,ChainSlots-1)]++;
+      Longest = std::max(Longest,Length);
+   }
+   cout << _("Total Hash Buckets: ") << Buckets << " (" <<
+      SizeToStr(Buckets*sizeof(map_ptrloc)) << ')' << endl;
+   cout << _("  Chain Lengths:");
+   for (unsigned int I = 0; I != ChainSlots; I++)
+      cout << ' ' << I << (I+1 == ChainSlots ? "+:" : ":") << Chains[I];
+   cout << endl;
+   cout << _("  Longest Chain: ") << Longest << endl;
+
    cout << _("Total Distinct Versions: ") << Cache.Head().VersionCount << " (" <<
       SizeToStr(Cache.Head().VersionCount*Cache.Head().VersionSz) << ')' << endl;
    cout << _("Total Dependencies: ") << Cache.Head().DependsCount << " (" <<
@@ -318,6 +344,11 @@ bool Stats(CommandLine &Cmd)
    }
    cout << _("Total Globbed Strings: ") << Count << " (" << SizeToStr(Size) << ')' << endl;
 
+   unsigned long const Interned = Cache.Head().InternHits + Cache.Head().InternMisses;
+   cout << _("Total Interned Strings: ") << Cache.Head().InternMisses << endl;
+   cout << _("  Interning Hits: ") << Cache.Head().InternHits << " (" <<
+      (Interned == 0 ? 0 : Cache.Head().InternHits*100/Interned) << "%)" << endl;
+
    unsigned long DepVerSize = 0;
    for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; P++)
    {
@@ -336,9 +367,13 @@ bool Stats(CommandLine &Cmd)
    for (int I = 0; I != 7; I++)
       Slack += Cache.Head().Pools[I].ItemSize*Cache.Head().Pools[I].Count;
    cout << _("Total Slack space: ") << SizeToStr(Slack) << endl;
+   cout << _("Total Dropped space: ") << SizeToStr(Cache.Head().DroppedSize) << endl;
+   cout << _("Total Map Growths: ") << Cache.Head().MapGrowths << endl;
 
    unsigned long Total = 0;
-   Total = Slack + Size + Cache.Head().DependsCount*Cache.Head().DependencySz +
+   Total = Slack + Size + Cache.Head().DroppedSize +
+           Buckets*sizeof(map_ptrloc) +
+           Cache.Head().DependsCount*Cache.Head().DependencySz +
            Cache.Head().VersionCount*Cache.Head().VersionSz +
            Cache.Head().PackageCount*Cache.Head().PackageSz +
            Cache.Head().VerFileCount*Cache.Head().VerFileSz +
@@ -406,6 +441,12 @@ bool DumpAvail(CommandLine &Cmd)
    // allocate and zero memory
    pkgCache::VerFile **VFList = new pkgCache::VerFile *[Count]();
 
+// CNC:2002-07-24
+#if HAVE_RPM
+   // One parser per file, formatting every record in the same buffer
+   pkgRecords Recs(Cache);
+#endif
+
    // Map versions that we want to write out onto the VerList array.
    for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; P++)
    {
@@ -458,7 +499,6 @@ bool DumpAvail(CommandLine &Cmd)
 #if HAVE_RPM
       if (VF.end() == false)
       {
-	 pkgRecords Recs(Cache);
 	 pkgRecords::Parser &P = Recs.Lookup(VF);
 	 const char *Start;
 	 const char *End;
@@ -1478,6 +1518,7 @@ struct ExVerFile
 {
    pkgCache::VerFile *Vf;
    bool NameMatch;
+   pkgCache::Version *Ver;
 };
 
 bool Search(CommandLine &CmdL)
@@ -1516,6 +1557,32 @@ bool Search(CommandLine &CmdL)
       return false;
    }
 
+   /* With a search index, only the records of the versions which have
+      words holding every plain pattern need to be read */
+   vector<bool> MayMatch;
+   pkgSearchIndex Index;
+   for (unsigned I = 0; I != NumPatterns && NamesOnly == false; I++)
+   {
+      if (pkgSearchIndex::Usable(CmdL.FileList[I+1]) == false)
+	 continue;
+      if (MayMatch.empty() == true)
+      {
+	 if (Index.Open(Cache) == false)
+	    break;
+	 MayMatch.assign(Cache.HeaderP->VersionCount,true);
+      }
+      vector<bool> Found(Cache.HeaderP->VersionCount,false);
+      Index.Find(CmdL.FileList[I+1],Found);
+      for (vector<bool>::size_type J = 0; J != Found.size(); J++)
+	 MayMatch[J] = MayMatch[J] && Found[J];
+   }
+   if (_error->PendingError() == true)
+   {
+      for (unsigned I = 0; I != NumPatterns; I++)
+	 regfree(&Patterns[I]);
+      return false;
+   }
+
    // allocate and zero memory (for a struct with
    // no user-provided constructors and only non-class members)
    ExVerFile *VFList = new ExVerFile[Cache.HeaderP->PackageCount+1]();
@@ -1539,7 +1606,10 @@ bool Search(CommandLine &CmdL)
       // Find the proper version to use.
       pkgCache::VerIterator V = Plcy.GetCandidateVer(P);
       if (V.end() == false)
+      {
 	 VFList[P->ID].Vf = V.FileList();
+	 VFList[P->ID].Ver = V;
+      }
    }
 
    // Include all the packages that provide matching names too
@@ -1554,6 +1624,7 @@ bool Search(CommandLine &CmdL)
 	 if (V.end() == false)
 	 {
 	    VFList[Prv.OwnerPkg()->ID].Vf = V.FileList();
+	    VFList[Prv.OwnerPkg()->ID].Ver = V;
 	    VFList[Prv.OwnerPkg()->ID].NameMatch = true;
 	 }
       }
@@ -1561,17 +1632,32 @@ bool Search(CommandLine &CmdL)
 
    LocalitySort(&VFList->Vf,Cache.HeaderP->PackageCount,sizeof(*VFList));
 
-   // Iterate over all the version records and check them
-   for (ExVerFile *J = VFList; J->Vf != 0; J++)
+   // Checks the record of J with Recs, giving what to print if it matches
+   auto Check = [&](pkgRecords &Recs,const ExVerFile *J,string &Out)
    {
-      pkgRecords::Parser &P = Recs.Lookup(pkgCache::VerFileIterator(Cache,J->Vf));
+      if (J->NameMatch == false && MayMatch.empty() == false &&
+	  MayMatch[J->Ver->ID] == false)
+	 return;
 
       bool Match = true;
       if (J->NameMatch == false)
       {
-	 string LongDesc = P.LongDesc();
-	 // CNC 2004-04-10
-	 string ShortDesc = P.ShortDesc();
+	 // The texts kept in the cache spare reading the record
+	 pkgCache::VerIterator V(Cache,J->Ver);
+	 string LongDesc;
+	 string ShortDesc;
+	 if (V.Summary() != 0 && V.Description() != 0)
+	 {
+	    LongDesc = V.Description();
+	    ShortDesc = V.Summary();
+	 }
+	 else
+	 {
+	    pkgRecords::Parser &P = Recs.Lookup(pkgCache::VerFileIterator(Cache,J->Vf));
+	    LongDesc = P.LongDesc();
+	    // CNC 2004-04-10
+	    ShortDesc = P.ShortDesc();
+	 }
 	 Match = NumPatterns != 0;
 	 for (unsigned I = 0; I != NumPatterns; I++)
 	 {
@@ -1585,16 +1671,102 @@ bool Search(CommandLine &CmdL)
 
       if (Match == true)
       {
+	 pkgRecords::Parser &P = Recs.Lookup(pkgCache::VerFileIterator(Cache,J->Vf));
 	 if (ShowFull == true)
 	 {
-	    const char *Start;
-	    const char *End;
-	    P.GetRec(Start,End);
-	    fwrite(Start,End-Start,1,stdout);
-	    putc('\n',stdout);
+	    P.AppendRec(Out);
+	    Out += '\n';
+	 }
+	 else
+	    Out += P.Name() + " - " + P.ShortDesc() + "\n";
+      }
+   };
+
+   ExVerFile *VFEnd = VFList;
+   while (VFEnd->Vf != 0)
+      VFEnd++;
+
+   const int Threads = _config->FindI("APT::Cache::Search-Threads",1);
+   if (Threads > 1 && VFEnd - VFList > 1)
+   {
+      /* The sorted versions come in runs from the same package file, and
+	 each run is checked by one thread with its own records parser. The
+	 output is kept until all are checked, to be printed in order. */
+      vector<ExVerFile *> Runs;
+      for (ExVerFile *J = VFList; J != VFEnd; J++)
+	 if (J == VFList || J->Vf->File != J[-1].Vf->File)
+	    Runs.push_back(J);
+      Runs.push_back(VFEnd);
+
+      vector<string> Output(VFEnd - VFList);
+      vector<std::pair<bool,string> > Messages;
+      vector<ExVerFile *>::size_type Next = 0;
+      std::mutex Lock;
+      // _error is kept per thread, so the first to fail tells the others
+      std::atomic<bool> Failed(false);
+      auto Work = [&]()
+      {
+	 pkgRecords Recs(Cache);
+	 if (_error->PendingError() == true)
+	    Failed = true;
+	 while (Failed == false)
+	 {
+	    vector<ExVerFile *>::size_type Run;
+	    {
+	       std::lock_guard<std::mutex> Guard(Lock);
+	       if (Next + 1 >= Runs.size())
+		  break;
+	       Run = Next++;
+	    }
+	    for (ExVerFile *J = Runs[Run]; J != Runs[Run+1]; J++)
+	       Check(Recs,J,Output[J - VFList]);
+	    if (_error->PendingError() == true)
+	       Failed = true;
+	 }
+
+	 // Hand over whatever went wrong in this thread
+	 std::lock_guard<std::mutex> Guard(Lock);
+	 string Text;
+	 while (_error->empty() == false)
+	 {
+	    bool Error = _error->PopMessage(Text);
+	    Messages.push_back(std::make_pair(Error,Text));
+	 }
+      };
+
+      // No more threads than runs to check
+      const vector<ExVerFile *>::size_type Count =
+	 std::min<vector<ExVerFile *>::size_type>(Threads,Runs.size() - 1);
+      vector<std::thread> Workers;
+      for (vector<ExVerFile *>::size_type I = 0; I != Count; I++)
+	 Workers.push_back(std::thread(Work));
+      for (vector<std::thread>::iterator I = Workers.begin(); I != Workers.end(); I++)
+	 I->join();
+
+      for (vector<std::pair<bool,string> >::iterator I = Messages.begin();
+	   I != Messages.end(); I++)
+      {
+	 if (I->first == true)
+	 {
+	    _error->Error("%s",I->second.c_str());
+	    Failed = true;
 	 }
 	 else
-	    printf("%s - %s\n",P.Name().c_str(),P.ShortDesc().c_str());
+	    _error->Warning("%s",I->second.c_str());
+      }
+      for (vector<string>::iterator I = Output.begin();
+	   Failed == false && I != Output.end(); I++)
+	 fwrite(I->data(),I->size(),1,stdout);
+   }
+   else
+   {
+      // Iterate over all the version records and check them
+      string Out;
+      for (ExVerFile *J = VFList; J != VFEnd; J++)
+      {
+	 Out.clear();
+	 Check(Recs,J,Out);
+	 fwrite(Out.data(),Out.size(),1,stdout);
       }
    }
 
@@ -1864,7 +2036,13 @@ bool GenCaches(CommandLine &Cmd)
    pkgSourceList List;
    if (List.ReadMainList() == false)
       return false;
-   return (pkgMakeStatusCache(List,Progress) != nullptr);
+   std::unique_ptr<MMap> Map = pkgMakeStatusCache(List,Progress);
+   if (Map == nullptr)
+      return false;
+   pkgCache Cache(*Map);
+   if (_error->PendingError() == true)
+      return false;
+   return pkgSearchIndex::Generate(Cache);
 }
 									/*}}}*/
 // ShowHelp - Show a help screen					/*{{{*/
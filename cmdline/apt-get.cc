@@ -44,6 +44,7 @@
 #include <apt-pkg/sptr.h>
 #include <apt-pkg/update.h>
 #include <apt-pkg/versionmatch.h>
+#include <apt-pkg/searchindex.h>
 
 #include <apti18n.h>
 
@@ -567,6 +568,28 @@ bool DownloadPackages(vector<string> &URLLst)
    return true;
 }
 									/*}}}*/
+// ShowBudget - Tell what the resolver left when its budget ran out	/*{{{*/
+// ---------------------------------------------------------------------
+/* The callers discard the errors of the resolver, its warning included,
+   and show the broken packages; this tells why it stopped. */
+static void ShowBudget(pkgProblemResolver &Fix)
+{
+   const pkgProblemResolver::Budget &Used = Fix.Spent();
+   if (Used.Exhausted == false)
+      return;
+
+   ioprintf(c1out,_("The problem resolver stopped after %lu steps and %.1f seconds, leaving these dependencies broken:\n"),
+	    Used.Steps,Used.Seconds);
+   const vector<pkgProblemResolver::Problem> &Left = Fix.Problems();
+   for (vector<pkgProblemResolver::Problem>::const_iterator P = Left.begin();
+	P != Left.end(); ++P)
+   {
+      pkgCache::DepIterator D = P->Dep;
+      c1out << "  " << P->Pkg.Name() << ' ' << D.DepType() << ' '
+	    << D.TargetPkg().Name() << endl;
+   }
+}
+									/*}}}*/
 // TryToInstall - Try to install a single package			/*{{{*/
 // ---------------------------------------------------------------------
 /* This used to be inlined in DoInstall, but with the advent of regex package
@@ -1176,7 +1199,7 @@ bool DoUpdate(CommandLine &CmdL)
    if (Cache.Open() == false)
       return false;
 
-   return true;
+   return pkgSearchIndex::Generate(Cache);
 }
 									/*}}}*/
 // DoUpgrade - Upgrade all packages					/*{{{*/
@@ -1511,7 +1534,10 @@ bool DoInstall(CommandLine &CmdL)
    // Call the scored problem resolver
    Fix.InstallProtect();
    if (Fix.Resolve(true) == false)
+   {
+      ShowBudget(Fix);
       _error->Discard();
+   }
 
 // CNC:2003-03-19
 #ifdef WITH_LUA
@@ -1761,6 +1787,7 @@ bool DoDSelectUpgrade(CommandLine &CmdL)
 
       if (Fix.Resolve() == false)
       {
+	 ShowBudget(Fix);
 	 ShowBroken(cerr,Cache,false);
 	 return _error->Error("Internal Error, problem resolver broke stuff");
       }
@@ -1789,6 +1816,10 @@ bool DoClean(CommandLine &CmdL)
    {
       cout << "Del " << _config->FindDir("Dir::Cache::archives") << "* " <<
 	 _config->FindDir("Dir::Cache::archives") << "partial/*" << endl;
+      if (_config->Find("Dir::Cache::parsed").empty() == false)
+	 cout << "Del " << _config->FindDir("Dir::Cache::parsed") << "*" << endl;
+      if (_config->Find("Dir::Cache::rpmdir").empty() == false)
+	 cout << "Del " << _config->FindDir("Dir::Cache::rpmdir") << "*" << endl;
       return true;
    }
 
@@ -1804,6 +1835,16 @@ bool DoClean(CommandLine &CmdL)
    pkgAcquire Fetcher;
    Fetcher.Clean(_config->FindDir("Dir::Cache::archives"));
    Fetcher.Clean(_config->FindDir("Dir::Cache::archives") + "partial/");
+
+   // The decoded lists and rpm-dir headers only speed up building the caches
+   string Parsed = _config->FindDir("Dir::Cache::parsed");
+   if (_config->Find("Dir::Cache::parsed").empty() == false &&
+       DirectoryExists(Parsed) == true)
+      Fetcher.Clean(Parsed);
+   string RpmDir = _config->FindDir("Dir::Cache::rpmdir");
+   if (_config->Find("Dir::Cache::rpmdir").empty() == false &&
+       DirectoryExists(RpmDir) == true)
+      Fetcher.Clean(RpmDir);
    return true;
 }
 									/*}}}*/
@@ -2346,7 +2387,10 @@ bool DoBuildDep(CommandLine &CmdL)
 
       Fix.InstallProtect();
       if (Fix.Resolve(true) == false)
+      {
+	 ShowBudget(Fix);
 	 _error->Discard();
+      }
 
       // Now we check the state of the packages,
       if (Cache->BrokenCount() != 0)
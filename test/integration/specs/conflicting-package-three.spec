@@ -0,0 +1,17 @@
+Name:      conflicting-package-three
+Version:   1
+Release:   alt1
+Summary:   Test package
+License:   LGPLv2+
+Group:     Other
+
+Conflicts: simple-package-noarch
+
+%description
+Dummy description
+
+%files
+
+%changelog
+* Sun Oct 18 2026 Nobody <nobody@altlinux.org> 1-alt1
+- Test package created
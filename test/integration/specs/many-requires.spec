@@ -0,0 +1,17 @@
+Name:      many-requires
+Version:   1
+Release:   alt1
+Summary:   Test package
+License:   LGPLv2+
+Group:     Other
+
+Requires: %(seq -f 'many-requires-dep-%%04g' 1000 | tr '\n' ' ')
+
+%description
+Dummy description
+
+%files
+
+%changelog
+* Mon Sep 30 2019 Nobody <nobody@altlinux.org> 1-alt1
+- Test package created